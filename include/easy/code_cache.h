@@ -2,6 +2,10 @@
 
 #include <easy/jit.h>
 #include <unordered_map>
+#include <list>
+#include <array>
+#include <mutex>
+#include <shared_mutex>
 #include <iostream>
 
 namespace easy {
@@ -16,21 +20,66 @@ class CacheBase {
 
   using Key = KeyTy;
 
+  // bounds the number of cached functions, where 0 means unbounded. Once
+  // the cache is full, the least recently used function is evicted, which
+  // invalidates any reference to it that was returned by jit.
+  void setMaxEntries(size_t Max) {
+    MaxEntries_ = Max;
+    evict();
+  }
+
+  size_t size() const {
+    return Cache_.size();
+  }
+
+  // the number of functions evicted so far.
+  size_t evictions() const {
+    return Evictions_;
+  }
+
   protected:
 
-  std::unordered_map<Key, easy::FunctionWrapperBase> Cache_;
-  using iterator = typename std::unordered_map<Key, easy::FunctionWrapperBase>::iterator;
+  using LRUList = std::list<Key const*>; // the most recently used is first
+
+  struct Slot {
+    easy::FunctionWrapperBase FW;
+    typename LRUList::iterator Use;
+  };
+
+  std::unordered_map<Key, Slot> Cache_;
+  using iterator = typename std::unordered_map<Key, Slot>::iterator;
+
+  LRUList LRU_;
+  size_t MaxEntries_ = 0;
+  size_t Evictions_ = 0;
+
+  void evict() {
+    while(MaxEntries_ && Cache_.size() > MaxEntries_) {
+      auto Oldest = Cache_.find(*LRU_.back());
+      LRU_.pop_back();
+      Cache_.erase(Oldest);
+      Evictions_++;
+    }
+  }
 
   template<class T, class ... Args>
   auto const & compile_if_not_in_cache(std::pair<iterator, bool> &CacheEntry, T &&Fun, Args&& ... args) {
     using wrapper_ty = decltype(easy::jit(std::forward<T>(Fun), std::forward<Args>(args)...));
 
-    FunctionWrapperBase &FWB = CacheEntry.first->second;
+    Slot &S = CacheEntry.first->second;
     if(CacheEntry.second) {
+      LRU_.push_front(&CacheEntry.first->first);
+      S.Use = LRU_.begin();
+
       auto FW = easy::jit(std::forward<T>(Fun), std::forward<Args>(args)...);
-      FWB = std::move(FW);
+      S.FW = std::move(FW);
+
+      // the new entry is the most recently used, so it is never evicted here.
+      evict();
+    } else {
+      LRU_.splice(LRU_.begin(), LRU_, S.Use);
     }
-    return reinterpret_cast<wrapper_ty&>(FWB);
+    return reinterpret_cast<wrapper_ty&>(S.FW);
   }
 };
 }
@@ -41,13 +90,13 @@ class Cache : public CacheBase<Key> {
 
   template<class T, class ... Args>
   auto const& EASY_JIT_COMPILER_INTERFACE jit(Key const &K, T &&Fun, Args&& ... args) {
-    auto CacheEntry = CacheBase<Key>::Cache_.emplace(K, FunctionWrapperBase());
+    auto CacheEntry = CacheBase<Key>::Cache_.emplace(K, typename CacheBase<Key>::Slot());
     return CacheBase<Key>::compile_if_not_in_cache(CacheEntry, std::forward<T>(Fun), std::forward<Args>(args)...);
   }
 
   template<class T, class ... Args>
   auto const& EASY_JIT_COMPILER_INTERFACE jit(Key &&K, T &&Fun, Args&& ... args) {
-    auto CacheEntry = CacheBase<Key>::Cache_.emplace(K, FunctionWrapperBase());
+    auto CacheEntry = CacheBase<Key>::Cache_.emplace(K, typename CacheBase<Key>::Slot());
     return CacheBase<Key>::compile_if_not_in_cache(CacheEntry, std::forward<T>(Fun), std::forward<Args>(args)...);
   }
 
@@ -68,7 +117,7 @@ class Cache<AutoKey> : public CacheBase<AutoKey> {
     auto CacheEntry =
         CacheBase<Key>::Cache_.emplace(
           Key(FunPtr, get_context_for<T, Args...>(std::forward<Args>(args)...)),
-          FunctionWrapperBase());
+          Slot());
     return CacheBase<Key>::compile_if_not_in_cache(CacheEntry, std::forward<T>(Fun), std::forward<Args>(args)...);
   }
 
@@ -82,4 +131,127 @@ class Cache<AutoKey> : public CacheBase<AutoKey> {
   }
 };
 
+
+
+namespace {
+template<class KeyTy, size_t NumShards>
+class ConcurrentCacheBase {
+
+  public:
+
+  using Key = KeyTy;
+
+  size_t size() const {
+    size_t Total = 0;
+    for(auto const &S : Shards_) {
+      std::shared_lock<std::shared_mutex> Reader(S.Lock);
+      Total += S.Map.size();
+    }
+    return Total;
+  }
+
+  protected:
+
+  // a slot is created on the first miss, and its function is compiled by
+  // whichever thread gets to the once_flag first. Slots are never removed,
+  // so the references returned by jit stay valid.
+  struct Slot {
+    std::once_flag Compiled;
+    easy::FunctionWrapperBase FW;
+  };
+
+  // each shard sits on its own cache line, so that threads using
+  // different shards do not contend.
+  struct alignas(64) Shard {
+    mutable std::shared_mutex Lock;
+    std::unordered_map<Key, std::unique_ptr<Slot>> Map;
+  };
+
+  std::array<Shard, NumShards> Shards_;
+
+  Shard& getShard(Key const &K) {
+    size_t H = std::hash<Key>{}(K);
+    return Shards_[(H ^ (H >> 17)) % NumShards];
+  }
+
+  Shard const& getShard(Key const &K) const {
+    return const_cast<ConcurrentCacheBase*>(this)->getShard(K);
+  }
+
+  Slot& getSlot(Key const &K) {
+    Shard &S = getShard(K);
+    {
+      std::shared_lock<std::shared_mutex> Reader(S.Lock);
+      auto Found = S.Map.find(K);
+      if(Found != S.Map.end())
+        return *Found->second;
+    }
+
+    std::unique_lock<std::shared_mutex> Writer(S.Lock);
+    auto &Entry = S.Map[K];
+    if(!Entry)
+      Entry = std::make_unique<Slot>();
+    return *Entry;
+  }
+
+  bool hasSlot(Key const &K) const {
+    Shard const &S = getShard(K);
+    std::shared_lock<std::shared_mutex> Reader(S.Lock);
+    return S.Map.find(K) != S.Map.end();
+  }
+
+  template<class T, class ... Args>
+  auto const & compile_once(Slot &S, T &&Fun, Args&& ... args) {
+    using wrapper_ty = decltype(easy::jit(std::forward<T>(Fun), std::forward<Args>(args)...));
+
+    std::call_once(S.Compiled, [&] {
+      S.FW = easy::jit(std::forward<T>(Fun), std::forward<Args>(args)...);
+    });
+    return reinterpret_cast<wrapper_ty&>(S.FW);
+  }
+};
+}
+
+// A thread-safe variant of Cache, split into shards that each have their own
+// lock. A hit only takes a shared lock on one shard, and the context it looks
+// up keeps its key inline, so a hit does not allocate either. When several
+// threads miss on the same key, only one of them compiles the function while
+// the others wait for it. Unlike Cache, nothing is ever evicted.
+template<class Key = AutoKey, size_t NumShards = 16>
+class ConcurrentCache : public ConcurrentCacheBase<Key, NumShards> {
+  using Base = ConcurrentCacheBase<Key, NumShards>;
+
+  public:
+
+  template<class T, class ... Args>
+  auto const& EASY_JIT_COMPILER_INTERFACE jit(Key const &K, T &&Fun, Args&& ... args) {
+    return Base::compile_once(Base::getSlot(K), std::forward<T>(Fun), std::forward<Args>(args)...);
+  }
+
+  bool has(Key const &K) const {
+    return Base::hasSlot(K);
+  }
+};
+
+template<size_t NumShards>
+class ConcurrentCache<AutoKey, NumShards> : public ConcurrentCacheBase<AutoKey, NumShards> {
+  using Base = ConcurrentCacheBase<AutoKey, NumShards>;
+  using Key = AutoKey;
+
+  public:
+
+  template<class T, class ... Args>
+  auto const& EASY_JIT_COMPILER_INTERFACE jit(T &&Fun, Args&& ... args) {
+    void* FunPtr = reinterpret_cast<void*>(meta::get_as_pointer(Fun));
+    Key K(FunPtr, get_context_for<T, Args...>(std::forward<Args>(args)...));
+    return Base::compile_once(Base::getSlot(K), std::forward<T>(Fun), std::forward<Args>(args)...);
+  }
+
+  template<class T, class ... Args>
+  bool has(T &&Fun, Args&& ... args) const {
+    void* FunPtr = reinterpret_cast<void*>(meta::get_as_pointer(Fun));
+    return Base::hasSlot(Key(FunPtr, get_context_for<T, Args...>(std::forward<Args>(args)...)));
+  }
+};
+
 }
@@ -10,6 +10,19 @@
 
 namespace easy {
 
+// the number of calls into JIT compiled code through a FunctionWrapper
+// that are running on this thread. The tuner uses it to tell whether the
+// thread may still be running a version that it obtained earlier.
+inline unsigned& activeCalls() {
+  thread_local unsigned Calls = 0;
+  return Calls;
+}
+
+struct ActiveCall {
+  ActiveCall() { activeCalls()++; }
+  ~ActiveCall() { activeCalls()--; }
+};
+
 class FunctionWrapperBase {
 
   protected:
@@ -77,6 +90,11 @@ class FunctionWrapper<Ret(Params...)> :
 
   template<class ... Args>
   Ret operator()(Args&& ... args) const {
+    ActiveCall Scope;
+
+    if (!FB_->sampleCall())
+      return getFunctionPointer()(std::forward<Args>(args)...);
+
     auto Token = FB_->startMeasurement();
 
     auto Result = getFunctionPointer()(std::forward<Args>(args)...);
@@ -108,6 +126,11 @@ class FunctionWrapper<void(Params...)> :
 
   template<class ... Args>
   void operator()(Args&& ... args) const {
+    ActiveCall Scope;
+
+    if (!FB_->sampleCall())
+      return getFunctionPointer()(std::forward<Args>(args)...);
+
     auto Token = FB_->startMeasurement();
 
     getFunctionPointer()(std::forward<Args>(args)...);
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <easy/jit.h>
+
+#include <dispatch/dispatch.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include <utility>
+
+namespace easy {
+
+namespace {
+
+// the value that the original function receives for one of its parameters
+// while the specialized version is not ready: either an argument of the call,
+// if the parameter was bound to a placeholder, or the bound value.
+template<class Bound, class CallTuple>
+decltype(auto) fallback_arg(Bound const &B, CallTuple &&Call) {
+  constexpr int PH = std::is_placeholder<Bound>::value;
+  if constexpr (PH > 0)
+    return std::get<PH-1>(std::move(Call));
+  else
+    return B;
+}
+
+// the copy of a bound argument that is kept for the fallback. A composed
+// function is passed to the original function as a plain function pointer.
+template<class Arg>
+auto capture_arg(Arg &&A) {
+  if constexpr (is_function_wrapper<std::decay_t<Arg>>::value)
+    return A.getFunctionPointer();
+  else
+    return std::decay_t<Arg>(std::forward<Arg>(A));
+}
+
+template<size_t ... I, class ... Args>
+auto capture_args(std::index_sequence<I...>, Args&& ... args) {
+  auto All = std::forward_as_tuple(std::forward<Args>(args)...);
+  return std::make_tuple(capture_arg(std::get<I>(All))...);
+}
+
+} // end anonymous namespace
+
+template<class WrapperTy>
+class AsyncFunction;
+
+/////
+// The result of easy::jit_async. Calls made before the specialized version is
+// ready go to the original (ahead-of-time compiled) function, with the bound
+// arguments filled in. Once the background compilation finishes, calls
+// switch to the specialized version, which only costs an atomic load.
+//
+// Copies of an AsyncFunction share the same compilation.
+template<class Ret, class ... Params>
+class AsyncFunction<FunctionWrapper<Ret(Params...)>> {
+  using FunPtrTy = Ret(*)(Params...);
+
+  struct State {
+    std::atomic<FunPtrTy> Specialized = nullptr;
+    std::function<Ret(Params...)> Fallback;
+
+    std::mutex Lock;
+    std::condition_variable Finished;
+    bool Done = false;
+    std::optional<FunctionWrapper<Ret(Params...)>> Compiled;
+    std::exception_ptr Error;
+  };
+
+  std::shared_ptr<State> State_;
+
+  public:
+
+  template<class OrigFunPtrTy, class BoundTy>
+  AsyncFunction(OrigFunPtrTy Orig, BoundTy Bound) : State_(std::make_shared<State>()) {
+    State_->Fallback = [Orig, Bound](Params ... call) -> Ret {
+      return std::apply([&](auto const& ... B) -> Ret {
+        return Orig(fallback_arg(B, std::forward_as_tuple(std::forward<Params>(call)...))...);
+      }, Bound);
+    };
+  }
+
+  template<class ... Args>
+  Ret operator()(Args&& ... args) const {
+    if (FunPtrTy Ptr = State_->Specialized.load(std::memory_order_acquire))
+      return Ptr(std::forward<Args>(args)...);
+    return State_->Fallback(std::forward<Args>(args)...);
+  }
+
+  // whether calls already go to the specialized version.
+  bool ready() const {
+    return State_->Specialized.load(std::memory_order_acquire) != nullptr;
+  }
+
+  // blocks until the background compilation has finished, and rethrows
+  // the exception that made it fail, if any.
+  void wait() const {
+    std::unique_lock<std::mutex> Guard(State_->Lock);
+    State_->Finished.wait(Guard, [this] { return State_->Done; });
+    if (State_->Error)
+      std::rethrow_exception(State_->Error);
+  }
+
+  // the specialized version, which waits for it if needed.
+  FunctionWrapper<Ret(Params...)> const& get() const {
+    wait();
+    return State_->Compiled.value();
+  }
+
+  // called by the background job once compilation has finished.
+  void finish(std::optional<FunctionWrapper<Ret(Params...)>> Compiled,
+              std::exception_ptr Error) const {
+    std::lock_guard<std::mutex> Guard(State_->Lock);
+    if (Compiled) {
+      State_->Compiled.emplace(std::move(Compiled.value()));
+      State_->Specialized.store(State_->Compiled->getFunctionPointer(),
+                                std::memory_order_release);
+    }
+    State_->Error = Error;
+    State_->Done = true;
+    State_->Finished.notify_all();
+  }
+};
+
+// Like easy::jit, but returns right away while the function is compiled in
+// the background. Until then, calls go to the original function.
+//
+// NOTE: composed functions (easy::FunctionWrapper arguments) must stay alive
+// until the compilation has finished.
+template<class T, class ... Args>
+auto EASY_JIT_COMPILER_INTERFACE jit_async(T &&Fun, Args&& ... args) {
+  using wrapper_ty = decltype(easy::jit(std::forward<T>(Fun), std::forward<Args>(args)...));
+  using FunOriginalTy = std::remove_pointer_t<std::decay_t<T>>;
+  using parameter_list = typename meta::function_traits<FunOriginalTy>::parameter_list;
+
+  auto* FunPtr = meta::get_as_pointer(Fun);
+  using FunPtrTy = decltype(FunPtr);
+
+  AsyncFunction<wrapper_ty> Async(FunPtr,
+      capture_args(std::make_index_sequence<parameter_list::size>(), std::forward<Args>(args)...));
+
+  auto C = get_context_for<T, Args...>(std::forward<Args>(args)...);
+
+  auto *Job = new std::function<void()>([Async, C, FunPtr] () {
+    try {
+      auto W = jit_with_context<FunPtrTy, Args...>(C, FunPtrTy(FunPtr));
+      Async.finish(std::move(W), nullptr);
+    } catch (...) {
+      Async.finish(std::nullopt, std::current_exception());
+    }
+  });
+
+  dispatch_async_f(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), Job,
+                   [] (void* Ctx) {
+                     auto *Task = static_cast<std::function<void()>*>(Ctx);
+                     (*Task)();
+                     delete Task;
+                   });
+
+  return Async;
+}
+
+}
@@ -74,6 +74,97 @@ namespace options{
       bool val_;
   };
 
+  // the maximum number of configurations whose IR is optimized
+  // concurrently when the tuner wants to compile ahead.
+  EASY_NEW_OPTION_STRUCT(optimize_width) {
+
+    optimize_width(unsigned val)
+               : val_(val) {}
+
+    EASY_HANDLE_OPTION_STRUCT(IGNORED, C) {
+      C.setOptimizeWidth(val_);
+    }
+
+    private:
+      unsigned val_;
+  };
+
+  // the number of milliseconds to wait on a compile job before
+  // giving up with a tuner::CompileJobTimeout exception.
+  EASY_NEW_OPTION_STRUCT(compile_timeout) {
+
+    compile_timeout(unsigned ms)
+               : ms_(ms) {}
+
+    EASY_HANDLE_OPTION_STRUCT(IGNORED, C) {
+      C.setCompileTimeout(ms_);
+    }
+
+    private:
+      unsigned ms_;
+  };
+
+  // the directory of an on-disk cache of compiled objects, which lets
+  // codegen be skipped for modules compiled by an earlier run.
+  EASY_NEW_OPTION_STRUCT(object_cache) {
+
+    object_cache(std::string const &dir)
+               : dir_(dir) {}
+
+    EASY_HANDLE_OPTION_STRUCT(IGNORED, C) {
+      C.setObjectCacheDir(dir_);
+    }
+
+    private:
+      std::string dir_;
+  };
+
+  // the maximum number of versions, other than the best one, that the
+  // ATDriver keeps around for a function + context. The worst are evicted.
+  EASY_NEW_OPTION_STRUCT(retained_versions) {
+
+    retained_versions(unsigned val)
+               : val_(val) {}
+
+    EASY_HANDLE_OPTION_STRUCT(IGNORED, C) {
+      C.setRetainedVersions(val_);
+    }
+
+    private:
+      unsigned val_;
+  };
+
+  // frees the IR of each compiled version once its machine code is
+  // emitted, since it is rarely needed again.
+  EASY_NEW_OPTION_STRUCT(code_only) {
+
+    code_only(bool on)
+               : on_(on) {}
+
+    EASY_HANDLE_OPTION_STRUCT(IGNORED, C) {
+      C.setCodeOnly(on_);
+    }
+
+    private:
+      bool on_;
+  };
+
+  // tunes a function bound with ATDriver::bind separately for each size
+  // class (i.e., power of two) of the integer passed for the given
+  // placeholder, where 1 means _1, and so on.
+  EASY_NEW_OPTION_STRUCT(dispatch_on) {
+
+    dispatch_on(unsigned placeholder)
+               : placeholder_(placeholder) {}
+
+    EASY_HANDLE_OPTION_STRUCT(IGNORED, C) {
+      C.setDispatchOn(placeholder_);
+    }
+
+    private:
+      unsigned placeholder_;
+  };
+
   // option used for writing the ir to a file, useful for debugging
   EASY_NEW_OPTION_STRUCT(dump_ir) {
     dump_ir(std::string const &file)
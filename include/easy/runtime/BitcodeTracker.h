@@ -6,6 +6,8 @@
 
 #include <unordered_map>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 namespace easy {
 
@@ -31,6 +33,29 @@ class BitcodeTracker {
   std::unordered_map<void*, FunctionInfo> Functions;
   std::unordered_map<std::string, void*> NameToAddress;
 
+  // A pool of LLVMContexts. A context is leased exclusively by getModule
+  // and comes back through releaseContext. Each context holds a pristine,
+  // parsed master copy of the module for every function it has served, so
+  // that a compile job only pays for a clone of a module instead of parsing
+  // its bitcode again. The masters stay in the context across leases, which
+  // is why a pooled context is never kept by a compiled function: it
+  // returns to the pool right after codegen. A context is only reused a
+  // bounded number of times, since it never shrinks.
+  //
+  // Each pooled context is marked by a PoolTag, installed as its diagnostic
+  // handler, which owns the masters and dies with the context. Thus, a
+  // context is known to be from the pool only while its tag is alive.
+  using MasterModules = std::unordered_map<void*, llvm::Module*>;
+  class PoolTag;
+
+  std::mutex PoolLock_;
+  std::vector<std::unique_ptr<llvm::LLVMContext>> IdleContexts_;
+  std::unordered_map<llvm::DiagnosticHandler const*, PoolTag*> Tags_;
+
+  std::unique_ptr<llvm::LLVMContext> leaseContext();
+  PoolTag* getTag(llvm::LLVMContext const &C);
+  std::unique_ptr<llvm::Module> parseModule(void* FPtr, llvm::LLVMContext &C);
+
   public:
 
   void registerFunction(void* FPtr, const char* Name, GlobalMapping* Globals, const char* Bitcode, size_t BitcodeLen) {
@@ -51,8 +76,12 @@ class BitcodeTracker {
    LLVMContext itself provides no locking guarantees, so you should be
    careful to have one context per thread."
 
-   Thus, right now, it seems we're stuck with parsing the bitcode into a new
-   chunk of memory on each JIT event.
+   Thus, we parse the bitcode once per pooled context, and then only clone
+   the parsed module on each JIT event. The context returned by getModule
+   is leased from a pool, so it must be handed back with releaseContext
+   once nothing but the master modules in it is in use anymore.
+   getModuleWithContext will also clone, rather than parse, if given a
+   context from the pool.
 
    */
 
@@ -60,6 +89,18 @@ class BitcodeTracker {
   ModuleContextPair getModule(void* FPtr);
   std::unique_ptr<llvm::Module> getModuleWithContext(void* FPtr, llvm::LLVMContext &C);
 
+  // whether the context was obtained from getModule, and so
+  // must be handed back rather than kept.
+  bool isPooled(llvm::LLVMContext const &C);
+
+  // returns a context obtained from getModule to the pool. Contexts that
+  // were not leased from the pool are simply destroyed.
+  void releaseContext(std::unique_ptr<llvm::LLVMContext> C);
+
+  // the number of times the bitcode of a function was parsed by this
+  // process, rather than cloned from a master module.
+  static uint64_t parses();
+
   // get the singleton object
   static BitcodeTracker& GetTracker();
 };
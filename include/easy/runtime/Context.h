@@ -2,8 +2,10 @@
 
 #include <vector>
 #include <memory>
+#include <atomic>
 #include <cstdint>
 #include <cstring>
+#include <algorithm>
 
 #include <easy/runtime/Function.h>
 #include <tuner/param.h>
@@ -34,7 +36,10 @@ namespace tuner {
     FB_Total,
     FB_Total_IgnoreError,
     FB_Recent,
-    FB_Recent_NP
+    FB_Recent_NP,
+    FB_Sampled,
+    FB_Cycles,
+    FB_Robust
   };
 
   static std::string FeedbackName(FeedbackKind FK) {
@@ -45,6 +50,9 @@ namespace tuner {
       case FB_Total_IgnoreError : return "total_ignore_err";
       case FB_Recent: return "recent";
       case FB_Recent_NP: return "recent_np";
+      case FB_Sampled: return "sampled";
+      case FB_Cycles: return "cycles";
+      case FB_Robust: return "robust";
       default: throw std::runtime_error("unknown feedback kind name");
     }
   }
@@ -52,6 +60,41 @@ namespace tuner {
 
 namespace easy {
 
+// a fast, non-cryptographic hash of a string of bytes, which mixes in
+// 8 bytes at a time (based on MurmurHash64A).
+inline size_t hashBytes(char const* Data, size_t Len, uint64_t Seed = 0) {
+  const uint64_t M = 0xc6a4a7935bd1e995ULL;
+  const int R = 47;
+  uint64_t H = Seed ^ (Len * M);
+
+  size_t i = 0;
+  for (; i + 8 <= Len; i += 8) {
+    uint64_t K;
+    std::memcpy(&K, Data + i, 8);
+    K *= M;
+    K ^= K >> R;
+    K *= M;
+    H ^= K;
+    H *= M;
+  }
+
+  if (i < Len) {
+    uint64_t K = 0;
+    std::memcpy(&K, Data + i, Len - i);
+    H ^= K;
+    H *= M;
+  }
+
+  H ^= H >> R;
+  H *= M;
+  H ^= H >> R;
+  return H;
+}
+
+inline size_t hashCombine(size_t A, size_t B) {
+  return A ^ (B + 0x9e3779b97f4a7c15ULL + (A << 6) + (A >> 2));
+}
+
 struct ArgumentBase {
 
   enum ArgumentKind {
@@ -123,12 +166,12 @@ DeclareArgument(Module, easy::Function const&);
 // the Data_ when doing comparisons.
 class IntRangeArgument
     : public ArgumentBase {
-  tuned_param::IntRange* Data_;
+  std::shared_ptr<tuned_param::IntRange> Data_;
   public:
-  IntRangeArgument(tuned_param::IntRange* D)
-    : ArgumentBase(), Data_(D) {};
-  virtual ~IntRangeArgument() { delete Data_; }
-  tuned_param::IntRange* get() const { return Data_; }
+  IntRangeArgument(std::shared_ptr<tuned_param::IntRange> D)
+    : ArgumentBase(), Data_(std::move(D)) {};
+  virtual ~IntRangeArgument() = default;
+  tuned_param::IntRange* get() const { return Data_.get(); }
   static constexpr ArgumentKind Kind = AK_IntRange;
   ArgumentKind kind() const noexcept override  { return Kind; }
 
@@ -161,34 +204,145 @@ class StructArgument
   }
 
   size_t hash() const noexcept override {
-    std::hash<int64_t> hash{};
-    size_t R = 0;
-    for (char c : Data_)
-      R ^= hash(c);
-    return R;
+    return hashBytes(Data_.data(), Data_.size());
+  }
+};
+
+// a string of bytes that keeps up to InlineSize of them inline, so that
+// building the key of a typical context never touches the heap.
+class ContextKey {
+  static constexpr size_t InlineSize = 64;
+
+  size_t Size_ = 0;
+  size_t Capacity_ = InlineSize;
+  std::unique_ptr<char[]> Heap_;
+  char Inline_[InlineSize];
+
+  char* buffer() { return Heap_ ? Heap_.get() : Inline_; }
+
+  void reserve(size_t Needed) {
+    if (Needed <= Capacity_)
+      return;
+    size_t NewCapacity = std::max(Needed, 2 * Capacity_);
+    std::unique_ptr<char[]> Bigger(new char[NewCapacity]);
+    std::memcpy(Bigger.get(), data(), Size_);
+    Heap_ = std::move(Bigger);
+    Capacity_ = NewCapacity;
+  }
+
+  public:
+  ContextKey() = default;
+
+  ContextKey(ContextKey const& Other) {
+    append(Other.data(), Other.size());
+  }
+
+  ContextKey& operator=(ContextKey const& Other) {
+    if (this != &Other) {
+      Size_ = 0;
+      append(Other.data(), Other.size());
+    }
+    return *this;
+  }
+
+  char const* data() const { return Heap_ ? Heap_.get() : Inline_; }
+  size_t size() const { return Size_; }
+
+  void append(char const* Bytes, size_t Len) {
+    reserve(Size_ + Len);
+    std::memcpy(buffer() + Size_, Bytes, Len);
+    Size_ += Len;
+  }
+
+  void push_back(char Byte) {
+    append(&Byte, 1);
+  }
+
+  bool operator==(ContextKey const& Other) const {
+    return Size_ == Other.Size_ && std::memcmp(data(), Other.data(), Size_) == 0;
   }
 };
 
 // class that holds information about the just-in-time context
 class Context {
 
-  std::vector<std::shared_ptr<ArgumentBase>> ArgumentMapping_;
+  using Arguments = std::vector<std::shared_ptr<ArgumentBase>>;
+
+  // the arguments as objects, which are decoded from the key only when a
+  // compiler first asks for them. A copy decodes its own.
+  class ArgumentCache {
+    mutable std::atomic<Arguments*> Args_{nullptr};
+
+    public:
+    ArgumentCache() = default;
+    ArgumentCache(ArgumentCache const&) {}
+    ArgumentCache& operator=(ArgumentCache const&) {
+      reset();
+      return *this;
+    }
+    ~ArgumentCache() { reset(); }
+
+    void reset() {
+      delete Args_.exchange(nullptr);
+    }
+
+    template<class DecodeFn>
+    Arguments const& get(DecodeFn &&Decode) const {
+      if (Arguments* Args = Args_.load(std::memory_order_acquire))
+        return *Args;
+
+      // racing decoders agree on the result, so the first one wins.
+      auto Fresh = std::make_unique<Arguments>(Decode());
+      Arguments* Expected = nullptr;
+      if (Args_.compare_exchange_strong(Expected, Fresh.get(), std::memory_order_acq_rel))
+        return *Fresh.release();
+      return *Expected;
+    }
+  };
+
+  // A flat encoding of the arguments, where each one is its kind followed
+  // by its value. It is all that is built for the arguments of a context,
+  // and two contexts have equal arguments exactly when their keys are
+  // equal, so hashing and comparing contexts takes a single pass over the
+  // key, without any virtual calls or heap-allocated arguments.
+  ContextKey Key_;
+  unsigned NumArgs_ = 0;
+  ArgumentCache Decoded_;
+
   unsigned OptLevel_ = 3, OptSize_ = 0;
   std::string DebugFile_;
   std::string DebugBeforeFile_;
 
   tuner::AutoTuner TunerKind_ = tuner::AT_None;
 
-  // NOTE: these values do not factor into the equality of two contexts,
-  // they are blind to these options.
+  // NOTE: the options below are also compared by operator==, since the
+  // driver keeps one entry per context, and uses the options that it was
+  // first created with. They are not hashed, as they rarely differ.
   tuner::FeedbackKind FeedbackKind_ = tuner::FB_None;
   bool WaitForCompile_ = false;
+  unsigned OptimizeWidth_ = 1;
+  unsigned CompileTimeoutMs_ = COMPILE_JOB_BAILOUT_MS;
+  std::string ObjectCacheDir_;
+  bool CodeOnly_ = false;
+  unsigned RetainedVersions_ = DEFAULT_RETAINED_VERSIONS;
+  unsigned DispatchOn_ = 0;
 
 
-  template<class ArgTy, class ... Args>
-  inline Context& setArg(Args && ... args) {
-    ArgumentMapping_.emplace_back(new ArgTy(std::forward<Args>(args)...));
-    return *this;
+  template<class T>
+  void appendKey(T const& Val) {
+    Key_.append(reinterpret_cast<char const*>(&Val), sizeof(T));
+  }
+
+  void beginArg(ArgumentBase::ArgumentKind Kind) {
+    Key_.push_back((char) Kind);
+    NumArgs_ += 1;
+    Decoded_.reset();
+  }
+
+  Arguments decodeArguments() const;
+
+  Arguments const& arguments() const {
+    return Decoded_.get([this] { return decodeArguments(); });
   }
 
   public:
@@ -239,6 +393,62 @@ class Context {
     return WaitForCompile_;
   }
 
+  Context& setOptimizeWidth(unsigned Width) {
+    OptimizeWidth_ = std::max(Width, 1u);
+    return *this;
+  }
+
+  unsigned getOptimizeWidth() const {
+    return OptimizeWidth_;
+  }
+
+  Context& setCompileTimeout(unsigned Ms) {
+    CompileTimeoutMs_ = Ms;
+    return *this;
+  }
+
+  unsigned getCompileTimeout() const {
+    return CompileTimeoutMs_;
+  }
+
+  Context& setObjectCacheDir(std::string const &Dir) {
+    ObjectCacheDir_ = Dir;
+    return *this;
+  }
+
+  std::string const& getObjectCacheDir() const {
+    return ObjectCacheDir_;
+  }
+
+  Context& setCodeOnly(bool CodeOnly) {
+    CodeOnly_ = CodeOnly;
+    return *this;
+  }
+
+  bool getCodeOnly() const {
+    return CodeOnly_;
+  }
+
+  Context& setRetainedVersions(unsigned Max) {
+    RetainedVersions_ = std::max(Max, 1u);
+    return *this;
+  }
+
+  unsigned getRetainedVersions() const {
+    return RetainedVersions_;
+  }
+
+  // the placeholder (1 for _1, etc.) whose argument selects the size class
+  // to tune for, or 0 if there is none.
+  Context& setDispatchOn(unsigned Placeholder) {
+    DispatchOn_ = Placeholder;
+    return *this;
+  }
+
+  unsigned getDispatchOn() const {
+    return DispatchOn_;
+  }
+
   tuner::AutoTuner getTunerKind() const {
     return TunerKind_;
   }
@@ -271,12 +481,21 @@ class Context {
     return DebugBeforeFile_;
   }
 
-  auto begin() const { return ArgumentMapping_.begin(); }
-  auto end() const { return ArgumentMapping_.end(); }
-  size_t size() const { return ArgumentMapping_.size(); }
+  ContextKey const& getKey() const {
+    return Key_;
+  }
+
+  size_t hash() const noexcept {
+    uint64_t Seed = (OptLevel_ << 16) ^ (OptSize_ << 8) ^ (uint64_t) TunerKind_;
+    return hashBytes(Key_.data(), Key_.size(), Seed);
+  }
+
+  auto begin() const { return arguments().begin(); }
+  auto end() const { return arguments().end(); }
+  size_t size() const { return NumArgs_; }
 
   ArgumentBase const& getArgumentMapping(size_t i) const {
-    return *ArgumentMapping_[i];
+    return *arguments()[i];
   }
 
   friend bool operator<(easy::Context const &C1, easy::Context const &C2);
@@ -293,8 +512,7 @@ namespace std
     typedef std::pair<L,R> argument_type;
     typedef std::size_t result_type;
     result_type operator()(argument_type const& s) const noexcept {
-      result_type H = std::hash<L>{}(s.first) ^ std::hash<R>{}(s.second);
-      return H;
+      return easy::hashCombine(std::hash<L>{}(s.first), std::hash<R>{}(s.second));
     }
   };
 
@@ -312,13 +530,7 @@ namespace std
     typedef easy::Context argument_type;
     typedef std::size_t result_type;
     result_type operator()(argument_type const& C) const noexcept {
-      size_t H = (size_t) C.getTunerKind();
-      std::hash<easy::ArgumentBase> ArgHash;
-      std::hash<std::pair<unsigned, unsigned>> OptHash;
-      for(auto const &Arg : C)
-        H ^= ArgHash(*Arg);
-      H ^= OptHash(C.getOptLevel());
-      return H;
+      return C.hash();
     }
   };
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <string>
 
 #include <easy/runtime/LLVMHolder.h>
 
@@ -57,7 +58,17 @@ class Function {
 
   bool operator==(easy::Function const&) const;
 
-  llvm::Module const& getLLVMModule() const;
+  // what identifies this function in operator== and std::hash.
+  easy::LLVMHolder const* getHolder() const {
+    return Holder.get();
+  }
+
+  // a copy of the module of this version, parsed into the given context.
+  std::unique_ptr<llvm::Module> getLLVMModule(llvm::LLVMContext &C) const;
+
+  // frees the IR and LLVMContext, keeping only the machine code. The
+  // module is parsed again from a bitcode copy if it is needed later.
+  void releaseIR();
 
   static std::unique_ptr<Function> CompileAndWrap (
     const char*Name, GlobalMapping* Globals,
@@ -65,7 +76,8 @@ class Function {
      std::unique_ptr<llvm::Module> M,
      llvm::CodeGenOpt::Level CGLevel,
      bool UseFastISel,
-     bool UseIPRA
+     bool UseIPRA,
+     std::string const& ObjectCacheDir = ""
   );
 
   static void WriteOptimizedToFile(llvm::Module const &M, std::string const& File, bool Append = false);
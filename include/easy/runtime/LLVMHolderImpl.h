@@ -1,22 +1,107 @@
 #pragma once
 
 #include <easy/runtime/LLVMHolder.h>
+#include <easy/runtime/BitcodeTracker.h>
+#include <easy/runtime/Compat.h>
 
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <mutex>
 
 namespace easy {
 class LLVMHolderImpl : public easy::LLVMHolder {
   public:
 
   std::unique_ptr<llvm::LLVMContext> Context_;
+#ifndef ORC_JIT
   std::unique_ptr<llvm::ExecutionEngine> Engine_;
-  llvm::Module* M_; // the execution engine has the ownership
+#endif
+  // the code lives in the shared ORC session, so the module is ours.
+  // Otherwise, we only own the module once the engine has given it up.
+  std::unique_ptr<llvm::Module> Module_;
+  llvm::Module* M_; // null while the IR is released
+
+  // the module in bitcode form, kept once the IR has been released.
+  llvm::SmallVector<char, 0> Bitcode_;
+  std::mutex Lock_;
 
+#ifdef ORC_JIT
+  LLVMHolderImpl(std::unique_ptr<llvm::Module> M, std::unique_ptr<llvm::LLVMContext> C)
+    : Context_(std::move(C)), Module_(std::move(M)), M_(Module_.get()) {
+    returnPooledContext();
+  }
+#else
   LLVMHolderImpl(std::unique_ptr<llvm::ExecutionEngine> EE, std::unique_ptr<llvm::LLVMContext> C, llvm::Module* M)
     : Context_(std::move(C)), Engine_(std::move(EE)), M_(M) {
+    returnPooledContext();
+  }
+#endif
+
+  // a context from the pool keeps the master modules of the functions it
+  // has served, so it goes back to the pool as soon as the code is emitted
+  // instead of staying with this version.
+  void returnPooledContext() {
+    if (BitcodeTracker::GetTracker().isPooled(*Context_))
+      releaseIR();
+  }
+
+  // frees the IR and its context, keeping only the machine code and a
+  // compact bitcode copy of the module.
+  void releaseIR() {
+    std::lock_guard<std::mutex> Guard(Lock_);
+    if (!M_)
+      return;
+
+    llvm::raw_svector_ostream Out(Bitcode_);
+    llvm::WriteBitcodeToFile(PASS_MODULE_ARG(*M_), Out);
+
+#ifndef ORC_JIT
+    // the generated code stays with the engine.
+    Engine_->removeModule(M_);
+    Module_.reset(M_);
+#endif
+    Module_.reset();
+    M_ = nullptr;
+    BitcodeTracker::GetTracker().releaseContext(std::move(Context_));
+  }
+
+  // a copy of the module parsed into the given context, which belongs to
+  // the caller, so that releasing the IR never pulls it out from under them.
+  std::unique_ptr<llvm::Module> copyModule(llvm::LLVMContext &C) {
+    std::lock_guard<std::mutex> Guard(Lock_);
+
+    llvm::SmallVector<char, 0> Fresh;
+    llvm::StringRef Bitcode(Bitcode_.data(), Bitcode_.size());
+    if (M_) {
+      llvm::raw_svector_ostream Out(Fresh);
+      llvm::WriteBitcodeToFile(PASS_MODULE_ARG(*M_), Out);
+      Bitcode = llvm::StringRef(Fresh.data(), Fresh.size());
+    }
+
+    auto Buf = llvm::MemoryBuffer::getMemBuffer(Bitcode, "", false);
+    return llvm::cantFail(llvm::parseBitcodeFile(*Buf, C));
+  }
+
+  // writes the module as bitcode, without parsing it again if released.
+  void writeBitcode(llvm::raw_ostream &Out) {
+    std::lock_guard<std::mutex> Guard(Lock_);
+    if (M_)
+      llvm::WriteBitcodeToFile(PASS_MODULE_ARG(*M_), Out);
+    else
+      Out.write(Bitcode_.data(), Bitcode_.size());
   }
 
-  virtual ~LLVMHolderImpl() = default;
+  virtual ~LLVMHolderImpl() {
+    // the module must be gone before its context can be reused.
+#ifndef ORC_JIT
+    Engine_.reset();
+#endif
+    Module_.reset();
+    BitcodeTracker::GetTracker().releaseContext(std::move(Context_));
+  }
 };
 }
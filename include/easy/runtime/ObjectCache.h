@@ -0,0 +1,39 @@
+#pragma once
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Support/CodeGen.h>
+
+#include <cstdint>
+#include <string>
+
+namespace easy {
+
+// An on-disk cache of compiled objects, so that a restarted process can skip
+// codegen for a module it has already compiled. Each object is stored in its
+// own file, named by a hash of the optimized module's bitcode along with
+// everything else that affects codegen: the codegen options, the host CPU, and
+// the version of LLVM. Cached objects are memory-mapped when loaded.
+//
+// An instance is meant to serve a single module.
+class DiskObjectCache : public llvm::ObjectCache {
+  std::string Dir_;
+  std::string Salt_;
+  std::string Key_;
+
+  std::string getKey(llvm::Module const*);
+  std::string getPath(std::string const &Key) const;
+
+  public:
+  DiskObjectCache(std::string const &Dir, llvm::CodeGenOpt::Level CGLevel,
+                  bool UseFastISel, bool UseIPRA);
+
+  void notifyObjectCompiled(const llvm::Module*, llvm::MemoryBufferRef) override;
+  std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module*) override;
+
+  // the number of objects that were loaded from a cache by this process,
+  // and the number that had to be compiled instead.
+  static uint64_t hits();
+  static uint64_t misses();
+};
+
+}
@@ -43,7 +43,7 @@ namespace tuner {
 
     bool missingCost(GenResult const& R) const {
       R.second->updateStats();
-      return R.second->goodQuality() == false;
+      return R.second->goodQuality() == false && !R.second->abandoned();
     }
 
     double getCost(GenResult const& R) const {
@@ -122,7 +122,7 @@ namespace tuner {
       // we do this here instead of in the constructor because we
       // want the first start to be aware of _all_ knobs.
       if (!initalizedFirstState) {
-        currentState = saveConfig(genDefaultConfig(KS_));
+        currentState = saveConfig(initialConfig());
         trialState = saveConfig(genRandomConfig(KS_, Gen_));
         initalizedFirstState = true;
       }
@@ -307,7 +307,7 @@ namespace tuner {
         if (Best.has_value())
           BestKC = *Best.value().first;
         else
-          BestKC = genDefaultConfig(KS_);
+          BestKC = initialConfig();
 
         for (uint32_t i = 0; i < XPloitSz; ++i, ++rowNum) {
           // FIXME: right now I just picked an arbitrary energy level.
@@ -447,7 +447,7 @@ namespace tuner {
         // NOTE: I think it's useful to always include the default config
         // in the first batch.
         if (numConfg == 0)
-          return saveConfig(genDefaultConfig(KS_));
+          return saveConfig(initialConfig());
 
         return saveConfig(genRandomConfig(KS_, Gen_));
       }
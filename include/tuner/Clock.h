@@ -0,0 +1,95 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#define ATJIT_HAS_TSC 1
+#endif
+
+namespace tuner {
+
+/////
+// the clock used to time calls. If the CPU has an invariant time stamp
+// counter, the clock reads it directly, which is much cheaper than
+// steady_clock::now(). Ticks are converted to nanoseconds on the same
+// timeline as steady_clock, using a scale calibrated on first use, which
+// takes a couple of milliseconds. Otherwise, the clock is steady_clock.
+class Clock {
+public:
+  using rep = int64_t;
+  using period = std::nano;
+  using duration = std::chrono::nanoseconds;
+  using time_point = std::chrono::time_point<Clock, duration>;
+  static constexpr bool is_steady = true;
+
+  struct Calibration {
+    bool UseTSC = false;
+    uint64_t TickBase = 0;
+    int64_t NanoBase = 0;
+    uint64_t Mult = 0; // nanoseconds per tick, in 32.32 fixed point.
+  };
+
+  static Calibration calibrate();
+
+  // calibrates on the first call, in whichever thread makes it, rather than
+  // in a static initializer that every program linking the runtime pays for.
+  static Calibration const& calibration() noexcept {
+    static const Calibration Calib = calibrate();
+    return Calib;
+  }
+
+  static time_point now() noexcept {
+#ifdef ATJIT_HAS_TSC
+    auto const& Calib = calibration();
+    if (Calib.UseTSC)
+      return fromTicks(Calib, __rdtsc());
+#endif
+    return steadyNow();
+  }
+
+  // begins a timed region. The counter is read once earlier instructions
+  // have finished, and later ones do not start before it is read.
+  static time_point start() noexcept {
+#ifdef ATJIT_HAS_TSC
+    auto const& Calib = calibration();
+    if (Calib.UseTSC) {
+      _mm_lfence();
+      uint64_t Ticks = __rdtsc();
+      _mm_lfence();
+      return fromTicks(Calib, Ticks);
+    }
+#endif
+    return steadyNow();
+  }
+
+  // ends a timed region. The counter is read once the instructions of
+  // the region have finished.
+  static time_point stop() noexcept {
+#ifdef ATJIT_HAS_TSC
+    auto const& Calib = calibration();
+    if (Calib.UseTSC) {
+      unsigned Aux;
+      uint64_t Ticks = __rdtscp(&Aux);
+      _mm_lfence();
+      return fromTicks(Calib, Ticks);
+    }
+#endif
+    return steadyNow();
+  }
+
+private:
+  static time_point steadyNow() noexcept {
+    auto Now = std::chrono::steady_clock::now().time_since_epoch();
+    return time_point(std::chrono::duration_cast<duration>(Now));
+  }
+
+  static time_point fromTicks(Calibration const& Calib, uint64_t Ticks) noexcept {
+    int64_t Delta = (int64_t) (Ticks - Calib.TickBase);
+    int64_t Nanos = (int64_t) (((__int128) Delta * Calib.Mult) >> 32);
+    return time_point(duration(Calib.NanoBase + Nanos));
+  }
+};
+
+} // end namespace
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <easy/function_wrapper.h>
+
+#include <atomic>
+#include <cstdint>
+
+namespace tuner {
+
+/////
+// Epoch-based reclamation of the versions and entries of an ATDriver, which
+// threads may still be looking at or running after they were made
+// unreachable.
+//
+// A thread pins the current epoch before it looks up what to call, and stays
+// pinned until it pins again while not inside a call into JIT compiled code
+// (see easy::activeCalls). So, a version it obtained is protected for as
+// long as the thread may run it, however long the call takes. Whatever is
+// made unreachable is tagged with the epoch returned by retire, and may be
+// freed once no thread is pinned at an older epoch.
+//
+// A thread that will not call any tuned function for a while should unpin,
+// since its pin keeps everything retired after it from being freed.
+class Epochs {
+public:
+  struct Record {
+    std::atomic<uint64_t> Epoch{0}; // 0 while not pinned.
+    std::atomic<bool> Taken{true};
+    Record* Next = nullptr;
+  };
+
+private:
+  static inline std::atomic<uint64_t> Global_{1};
+  static inline std::atomic<Record*> Head_{nullptr};
+
+  // the record of the calling thread, which is released when it exits.
+  static Record* acquireRecord();
+
+  static Record& self() {
+    thread_local Record* R = acquireRecord();
+    return *R;
+  }
+
+public:
+  static void pin() {
+    Record &R = self();
+    uint64_t Local = R.Epoch.load(std::memory_order_relaxed);
+
+    // inside a call, the thread may still be running what it obtained
+    // under its current pin.
+    if (Local != 0 && easy::activeCalls() > 0)
+      return;
+
+    uint64_t Now = Global_.load(std::memory_order_seq_cst);
+    if (Local == Now)
+      return;
+
+    R.Epoch.store(Now, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+
+  static void unpin() {
+    if (easy::activeCalls() == 0)
+      self().Epoch.store(0, std::memory_order_release);
+  }
+
+  // must be called after the object was made unreachable, returning the
+  // epoch to tag it with.
+  static uint64_t retire() {
+    return Global_.fetch_add(1, std::memory_order_seq_cst) + 1;
+  }
+
+  // whether no thread can still be using an object tagged with the epoch.
+  static bool quiescent(uint64_t Retired);
+};
+
+} // end namespace
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace tuner {
+
+  /////
+  // Bounds the cost of tuning across all of the functions tuned by one
+  // ATDriver, where a negative limit means unlimited (the default):
+  //
+  //  - the trial fraction bounds the share of a function's running time
+  //    spent in experimental versions rather than in its best version.
+  //
+  //  - the compile limit bounds the CPU time spent on compilation per
+  //    minute. It is a token bucket holding at most a minute's worth of
+  //    time. Compiling charges it past empty, so it is tracked as the time
+  //    at which it is back up to zero tokens.
+  //
+  // Once a limit is reached, the best versions are served instead of
+  // starting experiments, and compiling ahead stops. A function's first
+  // version is always compiled.
+  //
+  // All methods are thread safe.
+  class ExperimentBudget {
+    std::atomic<double> TrialFraction_;
+    std::atomic<double> CompileSecsPerMin_;
+
+    // in ns on the steady clock. Compiling is allowed while it is not
+    // in the future, and the bucket is full a window after it.
+    std::atomic<int64_t> ZeroTokensAt_ = 0;
+
+    std::atomic<uint64_t> CompileTime_ = 0; // total, in ns of CPU time
+
+  public:
+    ExperimentBudget(double TrialFraction = -1, double CompileSecsPerMin = -1)
+      : TrialFraction_(TrialFraction), CompileSecsPerMin_(CompileSecsPerMin) {}
+
+    void setTrialFraction(double Fraction) { TrialFraction_ = Fraction; }
+    void setCompileSecsPerMin(double Secs);
+
+    // whether another experiment may start for a function that has spent
+    // TrialTime in experiments and BestTime in its best versions.
+    bool trialAllowed(uint64_t TrialTime, uint64_t BestTime) const;
+
+    // whether any compile time is left.
+    bool compileAllowed() const;
+
+    // records that some CPU time was spent compiling.
+    void chargeCompile(uint64_t Nanos);
+
+    uint64_t compileTime() const { return CompileTime_.load(); }
+
+    // the CPU time used by the calling thread so far, in ns.
+    static uint64_t threadCPUTime();
+  };
+
+} // end namespace
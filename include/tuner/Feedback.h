@@ -8,8 +8,15 @@
 #include <iostream>
 #include <mutex>
 #include <cfloat>
+#include <array>
+#include <atomic>
+#include <vector>
+#include <algorithm>
 
 #include <tuner/Util.h>
+#include <tuner/Clock.h>
+#include <tuner/PerfCounters.h>
+#include <tuner/ThreadSlots.h>
 #include <tuner/JSON.h>
 
 #include <easy/runtime/Context.h>
@@ -20,20 +27,80 @@
 
 namespace tuner {
 
+// random bits that are cheap to produce, from a per-thread xorshift
+// generator. The result is never zero.
+inline uint32_t sampleBits() {
+  thread_local uint32_t State = 0;
+  if (State == 0)
+    State = (threadIndex() + 1) * 2654435761u | 1;
+
+  State ^= State << 13;
+  State ^= State >> 17;
+  State ^= State << 5;
+  return State;
+}
+
+// the amount of work (e.g., elements, bytes or FLOPs) done by each call that
+// the current thread makes, until it is changed. Measured times are divided
+// by it, so that calls on inputs of different sizes can be compared. Only
+// the samples are divided: the deployed time of a version, which drives the
+// driver's thresholds and budgets, is still in raw nanoseconds.
+inline double& currentWorkload() {
+  thread_local double Work = 1.0;
+  return Work;
+}
+
+// a value that is not positive resets the workload to 1.
+inline void setWorkload(double Units) {
+  currentWorkload() = Units > 0 ? Units : 1.0;
+}
+
 /////////////// BASE CLASS ///////////////
 
 class Feedback {
 protected:
   FeedbackKind FBK;
+
+  // a call is measured with probability 1 / (SampleMask + 1), where the mask
+  // is of the form 2^k - 1. NEVER_SAMPLE turns measurement off.
+  static constexpr uint32_t NEVER_SAMPLE = ~0U;
+  std::atomic<uint32_t> SampleMask = 0;
+
+  std::atomic<bool> Abandoned = false;
+
 public:
-  using TimePoint = std::chrono::time_point<std::chrono::steady_clock>;
+  using TimePoint = Clock::time_point;
 
   Feedback(FeedbackKind fk) : FBK(fk) {}
   virtual ~Feedback() = default;
 
-  // returns true iff this feedback object's expected value
-  // is lower than the given feedback, according to statistical inference.
-  bool betterThan(Feedback& Other);
+  // returns true iff this feedback object's expected value is lower than
+  // the given feedback's by at least the margin (a fraction of theirs),
+  // according to statistical inference at significance level alpha.
+  bool betterThan(Feedback& Other, double alpha = BETTER_THAN_ALPHA,
+                                   double margin = BETTER_THAN_MARGIN);
+
+  // marks that the driver stopped measuring this config early, because it
+  // was clearly worse than the best one. Its statistics may never become
+  // good, but its expected value is still a fair estimate.
+  void abandon() { Abandoned = true; }
+  bool abandoned() const { return Abandoned; }
+
+  // copies out the samples that a non-parametric comparison should use,
+  // returning false if this feedback does not keep them.
+  virtual bool keptSamples(std::vector<double> &Out) { return false; }
+
+  // whether the current call should be measured, which is decided
+  // without a virtual call or reading a clock.
+  bool sampleCall() const {
+    uint32_t Mask = SampleMask.load(std::memory_order_relaxed);
+    return Mask == 0 || (Mask != NEVER_SAMPLE && (sampleBits() & Mask) == 0);
+  }
+
+  // the number of calls that a measured call stands for.
+  uint64_t sampleWeight() const {
+    return (uint64_t) SampleMask.load(std::memory_order_relaxed) + 1;
+  }
 
   virtual TimePoint startMeasurement() = 0;
   virtual void endMeasurement(TimePoint) = 0;
@@ -61,14 +128,43 @@ public:
 /////////////// UTILITY FUNCTIONS ///////////////
 
 void calculateBasicStatistics(
-                                std::vector<Feedback::TimePoint>& startBuf,
-                                std::vector<Feedback::TimePoint>& endBuf,
+                                std::vector<double>& elapsedBuf,
                                 size_t sampleSz,
                                 double& average,
                                 double& variance,
                                 double& stdErr
                               );
 
+// the robust summary of a set of samples. Outliers are the samples further
+// than OUTLIER_MADS scaled median absolute deviations from the median;
+// the rest are kept, and the trimmed mean drops TRIM_FRACTION of the kept
+// samples from each end.
+struct RobustSummary {
+  double median = 0;
+  double trimmedMean = 0;
+  double variance = 0; // of the kept samples
+  size_t outliers = 0;
+};
+
+RobustSummary summarizeRobust(std::vector<double>& samples,
+                              std::vector<double>& kept);
+
+// the p-th quantile of the standard normal distribution.
+double normalQuantile(double p);
+
+// the p-th quantile of Student's t distribution with df degrees of freedom.
+double studentQuantile(double p, double df);
+
+// builds the tables of critical values used by betterThan, which take a few
+// milliseconds, if they were not built yet. The driver calls it up front,
+// since it runs betterThan while holding the lock of an entry.
+void prepareCriticalValues();
+
+// the one-sided Mann-Whitney U test of whether the values in Mine tend to
+// be lower than those in Theirs, at significance level alpha.
+bool mannWhitneyLower(std::vector<double> const& Mine,
+                      std::vector<double> const& Theirs, double alpha);
+
 
 
 /////////////// DERIVED CLASSES ///////////////
@@ -98,7 +194,9 @@ class NoOpFeedback : public NoOpBase {
 private:
   TimePoint dummy;
 public:
-  NoOpFeedback() : NoOpBase(FB_None), dummy(std::chrono::steady_clock::now()) { }
+  NoOpFeedback() : NoOpBase(FB_None), dummy(Clock::now()) {
+    SampleMask = NEVER_SAMPLE;
+  }
   TimePoint startMeasurement() override { return dummy; }
   void endMeasurement(TimePoint t) override { }
 
@@ -111,11 +209,11 @@ public:
 class DebuggingFB : public NoOpBase {
   DebuggingFB() : NoOpBase(FB_Debug) {}
   TimePoint startMeasurement() override {
-    return std::chrono::steady_clock::now();
+    return Clock::start();
   }
 
   void endMeasurement(TimePoint Start) override {
-    auto End = std::chrono::steady_clock::now();
+    auto End = Clock::stop();
     std::chrono::duration<int64_t, std::nano> elapsed = (End - Start);
     std::cout << "== elapsed time: " << elapsed.count() << " ns ==\n";
   }
@@ -125,71 +223,203 @@ class DebuggingFB : public NoOpBase {
 }; // end class
 
 
-class RecentFeedbackBuffer : public Feedback {
-private:
-  // circular buffer of samples.
-  // cur is the index of the oldest sample.
-  size_t cur = 0;
-
-protected:
-  std::atomic<size_t> observations = 0; // total. only most recent are tracked in detail.
-  std::atomic<uint64_t> deployedTime = 0; // total.
-
-  std::mutex bufLock;
-  std::vector<TimePoint> startBuf;
-  std::vector<TimePoint> endBuf;
-  size_t bufSz;
+/////////////// PER-THREAD ACCUMULATORS ///////////////
+
+// Each thread that runs a measured function records its samples into its own
+// accumulator, which only that thread writes. Thus, the updates below are
+// plain loads and stores rather than atomic adds; the fields are atomic only
+// so that a reader may take a snapshot while they change.
+
+// adds with saturation rather than overflow.
+inline uint64_t saturatingAdd(uint64_t A, uint64_t B) {
+  uint64_t Sum = A + B;
+  return Sum < A ? ~0ULL : Sum;
+}
+
+// the running mean and variance of one thread's samples.
+struct RunningStats {
+  std::atomic<uint64_t> Count{0};
+  std::atomic<uint64_t> Deployed{0};
+  std::atomic<double> Mean{0};
+  std::atomic<double> SumSqDiff{0};
+
+  struct Data {
+    uint64_t Count;
+    uint64_t Deployed;
+    double Mean;
+    double SumSqDiff;
+  };
+
+  void add(int64_t End, double Value, uint64_t DeployedTime) {
+    // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Welford's_online_algorithm
+    uint64_t N = Count.load(std::memory_order_relaxed) + 1;
+    double OldMean = Mean.load(std::memory_order_relaxed);
+    double NewMean = OldMean + (Value - OldMean) / N;
+    double SSD = SumSqDiff.load(std::memory_order_relaxed);
+
+    Count.store(N, std::memory_order_relaxed);
+    Deployed.store(saturatingAdd(Deployed.load(std::memory_order_relaxed), DeployedTime),
+                   std::memory_order_relaxed);
+    Mean.store(NewMean, std::memory_order_relaxed);
+    SumSqDiff.store(SSD + (Value - OldMean) * (Value - NewMean),
+                    std::memory_order_relaxed);
+  }
 
-public:
-  RecentFeedbackBuffer(FeedbackKind fk, size_t n = 10) : Feedback(fk), bufSz(n), startBuf(n), endBuf(n) { }
+  Data snapshot() const {
+    return { Count.load(std::memory_order_relaxed),
+             Deployed.load(std::memory_order_relaxed),
+             Mean.load(std::memory_order_relaxed),
+             SumSqDiff.load(std::memory_order_relaxed) };
+  }
+};
 
-  ~RecentFeedbackBuffer() { }
+// a circular buffer of one thread's most recent samples.
+struct RecentSamples {
+  static constexpr size_t Capacity = 32;
+
+  std::atomic<uint64_t> Count{0};
+  std::atomic<uint64_t> Deployed{0};
+  std::atomic<int64_t> End[Capacity] = {};
+  std::atomic<double> Value[Capacity] = {};
+
+  struct Data {
+    uint64_t Count;
+    uint64_t Deployed;
+    std::array<int64_t, Capacity> End;
+    std::array<double, Capacity> Value;
+  };
+
+  void add(int64_t EndTime, double Val, uint64_t DeployedTime) {
+    uint64_t N = Count.load(std::memory_order_relaxed);
+    End[N % Capacity].store(EndTime, std::memory_order_relaxed);
+    Value[N % Capacity].store(Val, std::memory_order_relaxed);
+    Count.store(N + 1, std::memory_order_relaxed);
+    Deployed.store(saturatingAdd(Deployed.load(std::memory_order_relaxed), DeployedTime),
+                   std::memory_order_relaxed);
+  }
 
-  TimePoint startMeasurement() override {
-    return std::chrono::steady_clock::now();
+  Data snapshot() const {
+    Data D;
+    D.Count = Count.load(std::memory_order_relaxed);
+    D.Deployed = Deployed.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < Capacity; i++) {
+      D.End[i] = End[i].load(std::memory_order_relaxed);
+      D.Value[i] = Value[i].load(std::memory_order_relaxed);
+    }
+    return D;
   }
+};
 
-  void endMeasurement(TimePoint Start) override {
-    auto End = std::chrono::steady_clock::now();
 
-    /////// update the circular buffer
+// a feedback object whose measurements take no lock: samples go to the
+// calling thread's accumulator, which are merged when the stats are updated.
+template<typename Acc>
+class PerThreadFeedback : public Feedback {
+protected:
+  ThreadSlots<Acc> Samples;
 
-    // TODO: make thread-specific buffers to avoid the need for a lock.
+  // the total deployed time as of the last reset.
+  std::atomic<uint64_t> deployedBase = 0;
 
-    //////////////////////////////////////
-    // START the critical section
-    bufLock.lock();
-    // TODO: I don't really think we need to be tracking total deployed time.
-    // we can cut overhead out by not tracking it.
+  uint64_t totalDeployedTime() const {
+    uint64_t Total = 0;
+    Samples.forEach([&](auto const& S) {
+      Total = saturatingAdd(Total, S.Deployed);
+    });
+    return Total;
+  }
+
+  // records the time since Start, returning the number of samples
+  // that the current thread has recorded so far.
+  uint64_t record(TimePoint Start) {
+    auto End = Clock::stop();
     std::chrono::duration<int64_t, std::nano> elapsedDur = (End - Start);
     int64_t elapsedTime = elapsedDur.count();
     assert(elapsedTime > 0 && "encountered a negative time?");
 
-    startBuf[cur] = Start;
-    endBuf[cur] = End;
-    cur = (cur + 1) % bufSz;
-    observations++;
-    deployedTime += elapsedTime;
+    // the sample is the time per unit of work.
+    return recordSample(End, elapsedTime, elapsedTime / currentWorkload());
+  }
 
-    //////////////////////////////////////
-    // END of critical section
-    bufLock.unlock();
+  // records a sample with the given value, for a call that ended at End.
+  uint64_t recordSample(TimePoint End, int64_t elapsedTime, double Value) {
+    // the deployed time of an unmeasured call is assumed to be the same.
+    int64_t EndTime = End.time_since_epoch().count();
+    uint64_t Deployed = elapsedTime * sampleWeight();
+    uint64_t Count = 0;
+    Samples.update([&](Acc &A) {
+      A.add(EndTime, Value, Deployed);
+      Count = A.Count.load(std::memory_order_relaxed);
+    });
+    return Count;
+  }
+
+public:
+  PerThreadFeedback(FeedbackKind fk) : Feedback(fk) {}
+
+  TimePoint startMeasurement() override {
+    return Clock::start();
+  }
+
+  void endMeasurement(TimePoint Start) override {
+    record(Start);
   }
 
   void resetDeployedTime() override {
-    deployedTime = 0;
+    deployedBase = totalDeployedTime();
   }
 
   uint64_t getDeployedTime() override {
-    return deployedTime;
+    uint64_t Total = totalDeployedTime();
+    uint64_t Base = deployedBase;
+    return Total > Base ? Total - Base : 0;
   }
+};
+
+
 
+class RecentFeedbackBuffer : public PerThreadFeedback<RecentSamples> {
+protected:
+  size_t bufSz;
+
+  // the most recent samples across all threads, and the total number
+  // of samples seen.
+  void collectRecent(std::vector<double> &Values, uint64_t &Total) const {
+    std::vector<std::pair<int64_t, double>> All; // (end, value)
+    Total = 0;
+
+    Samples.forEach([&](RecentSamples::Data const& S) {
+      Total += S.Count;
+      size_t Valid = std::min<uint64_t>(S.Count, RecentSamples::Capacity);
+      for (size_t i = 0; i < Valid; i++)
+        All.emplace_back(S.End[i], S.Value[i]);
+    });
+
+    size_t Keep = std::min(bufSz, All.size());
+    std::partial_sort(All.begin(), All.begin() + Keep, All.end(),
+                      [](auto const& A, auto const& B) { return A.first > B.first; });
+
+    Values.clear();
+    for (size_t i = 0; i < Keep; i++)
+      Values.push_back(All[i].second);
+  }
+
+public:
+  RecentFeedbackBuffer(FeedbackKind fk, size_t n = 10)
+    : PerThreadFeedback(fk), bufSz(std::min(n, RecentSamples::Capacity)) { }
+
+  ~RecentFeedbackBuffer() { }
 };
 
 
 
 class RecentExecutionTime : public RecentFeedbackBuffer {
 private:
+  // this lock protects the fields below, which are only
+  // computed by updateStats.
+  std::mutex statsLock;
+
+  uint64_t observations = 0;
   size_t lastCalc = 0;
   double errPctThreshold; // set once.
 
@@ -205,22 +435,21 @@ public:
         errPctThreshold(errBound) {}
 
   virtual void updateStats() override {
+    std::vector<double> Values;
+    uint64_t Total;
+    collectRecent(Values, Total);
+
+    std::lock_guard<std::mutex> Guard(statsLock);
+    observations = Total;
     if (lastCalc == observations)
       return;
 
-
     // new observations have come in since this method
     // was last called, so we recalulate things.
-    bufLock.lock();
     lastCalc = observations;
-    sampleSz = std::min(bufSz, lastCalc);
-
-    std::vector<TimePoint> startBufCopy(startBuf);
-    std::vector<TimePoint> endBufCopy(endBuf);
-    bufLock.unlock();
+    sampleSz = Values.size();
 
-    // perform calculations without lock held
-    calculateBasicStatistics(startBufCopy, endBufCopy, sampleSz, average, sampleVariance, stdErr);
+    calculateBasicStatistics(Values, sampleSz, average, sampleVariance, stdErr);
   }
 
   virtual bool goodQuality() const override {
@@ -260,10 +489,17 @@ public:
 
 
 
-class TotalExecutionTime : public RecentFeedbackBuffer {
-private:
+class TotalExecutionTime : public PerThreadFeedback<RunningStats> {
+protected:
+  // what the samples measure.
+  const char* Unit = "nano";
+
+  // adds more fields to the output of dump.
+  virtual void dumpExtra(std::ostream &os) {}
+
   //////////////
-  // this lock protects all fields of this object.
+  // this lock protects the statistics below, which are merged from
+  // the per-thread samples by updateStats.
   std::mutex protecc;
 
   double average = 0; // cumulative
@@ -271,7 +507,6 @@ private:
   double stdDev = 0; // unbiased sample standard deviation
   double stdError = 0;
   double stdErrorPct = 0;
-  double sumSqDiff = 0;
   double errBound = 0; // a precentage
   uint64_t dataPoints = 0;
 
@@ -289,87 +524,57 @@ public:
   // a value >= 0 says:  return if you have at least 2 observations, where
   //                     the precent std err of the mean is <= the value.
   TotalExecutionTime(double errPctBound = DEFAULT_STD_ERR_PCT)
-      : RecentFeedbackBuffer(FB_Total),
+      : PerThreadFeedback(FB_Total),
         errBound(errPctBound) {
         if (errPctBound < 0)
           FBK = FB_Total_IgnoreError;
       }
 
-
-  TimePoint startMeasurement() override {
-    return std::chrono::steady_clock::now();
-  }
-
-  void endMeasurement(TimePoint Start) override {
-    auto End = std::chrono::steady_clock::now();
-    std::chrono::duration<int64_t, std::nano> elapsedDur = (End - Start);
-
-    int64_t elapsedTime = elapsedDur.count();
-
-    assert(elapsedTime > 0 && "encountered a negative time?");
-
-    ////////////////////////////////////////////////////////////////////
-    // START the critical section
-    protecc.lock();
-
-    // calculate new deployed time with overflow check.
-    uint64_t newDeployedTime = deployedTime + elapsedTime;
-    if (newDeployedTime < deployedTime)
-      newDeployedTime = ~0ULL;
-
-    deployedTime = newDeployedTime;
-
-    dataPoints++;
-
-    if (dataPoints == 1) {
-      average = elapsedTime;
-
-      ////////////////////////////////////////////////////////////////////
-      // END of critical section
-      protecc.unlock();
-      return;
-    } // end if
-
+  void updateStats() override {
     /////////////
-    // sources for these forumlas:
+    // merge the per-thread statistics. sources for these forumlas:
     //
-    // https://en.wikipedia.org/wiki/Moving_average#Cumulative_moving_average
-    // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Online_algorithm
+    // https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Parallel_algorithm
     // https://en.wikipedia.org/wiki/Standard_deviation#Unbiased_sample_standard_deviation
     // https://en.wikipedia.org/wiki/Standard_error#Estimate
+    uint64_t N = 0;
+    double Mean = 0;
+    double SumSqDiff = 0;
 
-    const double N = dataPoints;
-
-    const double newAvg = (elapsedTime + ((N-1) * average)) / N;
+    Samples.forEach([&](RunningStats::Data const& S) {
+      if (S.Count == 0)
+        return;
 
-    sumSqDiff += (elapsedTime - average) * (elapsedTime - newAvg);
-    sampleVariance = sumSqDiff / (N-1);
+      double Delta = S.Mean - Mean;
+      uint64_t Merged = N + S.Count;
+      Mean += Delta * S.Count / Merged;
+      SumSqDiff += S.SumSqDiff + Delta * Delta * ((double) N * S.Count / Merged);
+      N = Merged;
+    });
 
-    // we use the approximation of the correction for a normal distribution.
-    stdDev = std::sqrt(sumSqDiff / (N - 1.5));
+    ////////////////////////////////////////////////////////////////////
+    // START the critical section
+    std::lock_guard<std::mutex> Guard(protecc);
 
-    stdError = stdDev / std::sqrt(N);
+    dataPoints = N;
+    average = Mean;
 
-    stdErrorPct = (stdError / newAvg) * 100.0;
+    if (N >= 2) {
+      sampleVariance = SumSqDiff / (N-1);
 
-    average = newAvg;
+      // we use the approximation of the correction for a normal distribution.
+      stdDev = std::sqrt(SumSqDiff / (N - 1.5));
 
-    ////////////////////////////////////////////////////////////////////
-    // END of critical section
-    protecc.unlock();
-    return;
-  } // end of endMeasurement
+      stdError = stdDev / std::sqrt(N);
 
-  void updateStats() override {
-    ////////////////////////////////////////////////////////////////////
-    // START the critical section
-    protecc.lock();
+      stdErrorPct = (stdError / Mean) * 100.0;
+    }
 
     ca_goodQuality =
           (dataPoints > DEFAULT_MIN_TRIALS && stdErrorPct <= errBound)
                || ((dataPoints >= 1) && errBound < 0);
 
-    ca_mean = average;
+    ca_mean = dataPoints ? average : std::numeric_limits<double>::max();
 
     ca_variance = sampleVariance;
 
@@ -377,7 +582,6 @@ public:
 
     ////////////////////////////////////////////////////////////////////
     // END of critical section
-    protecc.unlock();
   }
 
   bool goodQuality() const override { return ca_goodQuality; }
@@ -387,12 +591,11 @@ public:
 
 
   void dump (std::ostream &os) override {
-    // TODO: call updateStats and do not access other fields
-    // to avoid need for lock.
+    updateStats();
 
     ////////////////////////////////////////////////////////////////////
     // START the critical section
-    protecc.lock();
+    std::lock_guard<std::mutex> Guard(protecc);
 
     JSON::beginObject(os);
 
@@ -400,11 +603,12 @@ public:
     JSON::output(os, "measurements", dataPoints, dataPoints != 0);
 
     if (dataPoints != 0) {
-      JSON::output(os, "unit", "nano");
+      JSON::output(os, "unit", Unit);
       JSON::output(os, "time", average);
       JSON::output(os, "std_error_pct", stdErrorPct);
       JSON::output(os, "variance", sampleVariance);
       JSON::output(os, "std_dev", stdDev);
+      dumpExtra(os);
       JSON::output(os, "std_error_mean", stdError, false);
     }
 
@@ -412,7 +616,347 @@ public:
 
     ////////////////////////////////////////////////////////////////////
     // END of critical section
-    protecc.unlock();
+  }
+}; // end class
+
+
+
+// measures only some of the calls once the statistics are good. The more
+// often the function is called, and the less noisy its times are, the
+// fewer calls are measured. The rest make a plain call.
+class SampledExecutionTime : public TotalExecutionTime {
+private:
+  // protects the fields below. Threads that find it taken skip adapting.
+  std::mutex adaptLock;
+  TimePoint lastAdapt = Clock::now();
+  uint64_t lastCount = 0;
+
+  // picks the sampling period based on the recent call rate and the
+  // quality of the statistics.
+  void adapt() {
+    std::unique_lock<std::mutex> Guard(adaptLock, std::try_to_lock);
+    if (!Guard.owns_lock())
+      return;
+
+    updateStats();
+
+    auto Now = Clock::now();
+    std::chrono::duration<double> Secs = Now - lastAdapt;
+
+    uint64_t Count;
+    double Period = 1;
+    {
+      std::lock_guard<std::mutex> StatsGuard(protecc);
+      Count = dataPoints;
+
+      if (ca_goodQuality && Secs.count() > 0) {
+        // the number of calls per second, including unmeasured ones.
+        double Rate = (Count - lastCount) * (double) sampleWeight() / Secs.count();
+        double Limit = std::min(Rate / SAMPLE_TARGET_PER_SEC, (double) SAMPLE_MAX_PERIOD);
+
+        // measuring 1/k of the calls makes the std error grow by sqrt(k),
+        // which must stay within the bound.
+        if (errBound >= 0 && stdErrorPct > 0)
+          Limit = std::min(Limit, std::pow(errBound / stdErrorPct, 2));
+
+        while (Period * 2 <= Limit)
+          Period *= 2;
+      }
+    }
+
+    SampleMask = (uint32_t) Period - 1;
+    lastAdapt = Now;
+    lastCount = Count;
+  }
+
+public:
+  SampledExecutionTime(double errPctBound = DEFAULT_STD_ERR_PCT)
+      : TotalExecutionTime(errPctBound) {
+        FBK = FB_Sampled;
+      }
+
+  void endMeasurement(TimePoint Start) override {
+    if (record(Start) % SAMPLE_ADAPT_EVERY == 0)
+      adapt();
+  }
+}; // end class
+
+
+// one thread's most recent samples. The median is taken over the last
+// Capacity calls of every thread, pooled together, rather than kept by a
+// streaming quantile estimator such as P-square or a t-digest. The
+// estimates of separate threads could not be merged exactly, and the
+// outlier rejection and the rank test need the samples themselves anyway.
+struct RobustSamples {
+  static constexpr size_t Capacity = 64;
+
+  std::atomic<uint64_t> Count{0};
+  std::atomic<uint64_t> Deployed{0};
+  std::atomic<double> Value[Capacity] = {};
+
+  struct Data {
+    uint64_t Count;
+    uint64_t Deployed;
+    std::array<double, Capacity> Value;
+  };
+
+  void add(int64_t EndTime, double Val, uint64_t DeployedTime) {
+    uint64_t N = Count.load(std::memory_order_relaxed);
+    Value[N % Capacity].store(Val, std::memory_order_relaxed);
+    Count.store(N + 1, std::memory_order_relaxed);
+    Deployed.store(saturatingAdd(Deployed.load(std::memory_order_relaxed), DeployedTime),
+                   std::memory_order_relaxed);
+  }
+
+  Data snapshot() const {
+    Data D;
+    D.Count = Count.load(std::memory_order_relaxed);
+    D.Deployed = Deployed.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < Capacity; i++)
+      D.Value[i] = Value[i].load(std::memory_order_relaxed);
+    return D;
+  }
+};
+
+
+
+// judges configs by the median time of their recent calls rather than the
+// mean, after rejecting outliers such as calls that were preempted or that
+// took a page fault. Two such feedback objects are compared with a rank test, which
+// does not assume that the times are normally distributed.
+class RobustExecutionTime : public PerThreadFeedback<RobustSamples> {
+private:
+  // this lock protects the fields below, which are only
+  // computed by updateStats. They are read under it too, so that a reader
+  // never pairs the results of two different updates.
+  mutable std::mutex statsLock;
+
+  double errBound; // a percentage, set once.
+  uint64_t observations = 0;
+  uint64_t lastCalc = 0;
+
+  RobustSummary summary;
+  std::vector<double> kept;
+  double median = std::numeric_limits<double>::max();
+  double stdErr = 0;
+  double stdErrPct = 0;
+  bool quality = false;
+
+public:
+  RobustExecutionTime(double errPctBound = DEFAULT_STD_ERR_PCT)
+      : PerThreadFeedback(FB_Robust), errBound(errPctBound) {}
+
+  void updateStats() override {
+    std::vector<double> Values;
+    uint64_t Total = 0;
+
+    Samples.forEach([&](RobustSamples::Data const& S) {
+      if (S.Count == 0)
+        return;
+
+      Total += S.Count;
+
+      size_t Valid = std::min<uint64_t>(S.Count, RobustSamples::Capacity);
+      Values.insert(Values.end(), S.Value.begin(), S.Value.begin() + Valid);
+    });
+
+    std::lock_guard<std::mutex> Guard(statsLock);
+    observations = Total;
+    if (lastCalc == observations)
+      return;
+    lastCalc = observations;
+
+    // the median of the recent samples of all threads, pooled together.
+    summary = summarizeRobust(Values, kept);
+    median = summary.median;
+
+    // the std error of the median is about sqrt(pi/2) times that of the mean,
+    // for normally distributed data.
+    size_t N = kept.size();
+    stdErr = N >= 2 ? 1.2533 * std::sqrt(summary.variance / N) : 0;
+    stdErrPct = 100.0 * (stdErr / median);
+
+    quality = N > DEFAULT_MIN_TRIALS && stdErrPct <= errBound;
+  }
+
+  bool keptSamples(std::vector<double> &Out) override {
+    std::lock_guard<std::mutex> Guard(statsLock);
+    Out = kept;
+    return !Out.empty();
+  }
+
+  bool goodQuality() const override {
+    std::lock_guard<std::mutex> Guard(statsLock);
+    return quality;
+  }
+  double expectedValue() const override {
+    std::lock_guard<std::mutex> Guard(statsLock);
+    return median;
+  }
+  double variance() const override {
+    std::lock_guard<std::mutex> Guard(statsLock);
+    return summary.variance;
+  }
+  size_t sampleSize() const override {
+    std::lock_guard<std::mutex> Guard(statsLock);
+    return kept.size();
+  }
+
+  void dump(std::ostream &os) override {
+    updateStats();
+
+    std::lock_guard<std::mutex> Guard(statsLock);
+
+    JSON::beginObject(os);
+
+    JSON::output(os, "kind", FeedbackName(FBK));
+    JSON::output(os, "measurements", observations, observations != 0);
+
+    if (observations != 0) {
+      JSON::output(os, "unit", "nano");
+      JSON::output(os, "time", median);
+      JSON::output(os, "trimmed_mean", summary.trimmedMean);
+      JSON::output(os, "sample_size", kept.size());
+      JSON::output(os, "outliers", summary.outliers);
+      JSON::output(os, "variance", summary.variance);
+      JSON::output(os, "std_error_pct", stdErrPct);
+      JSON::output(os, "std_error_median", stdErr, false);
+    }
+
+    JSON::endObject(os);
+  }
+}; // end class
+
+
+// the sums of one thread's hardware counters over its measured calls.
+struct CounterSums {
+  std::atomic<uint64_t> Count{0};
+  std::atomic<uint64_t> Multiplexed{0}; // calls whose counts were scaled
+  std::atomic<uint64_t> Sum[PC_NumCounters] = {};
+
+  struct Data {
+    uint64_t Count;
+    uint64_t Multiplexed;
+    std::array<uint64_t, PC_NumCounters> Sum;
+  };
+
+  void add(PerfCounters::Values const& Delta, bool Scaled) {
+    Count.store(Count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (Scaled)
+      Multiplexed.store(Multiplexed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    for (unsigned i = 0; i < PC_NumCounters; i++)
+      Sum[i].store(Sum[i].load(std::memory_order_relaxed) + Delta[i], std::memory_order_relaxed);
+  }
+
+  Data snapshot() const {
+    Data D;
+    D.Count = Count.load(std::memory_order_relaxed);
+    D.Multiplexed = Multiplexed.load(std::memory_order_relaxed);
+    for (unsigned i = 0; i < PC_NumCounters; i++)
+      D.Sum[i] = Sum[i].load(std::memory_order_relaxed);
+    return D;
+  }
+};
+
+
+
+// measures calls in CPU cycles, counted by the hardware for the calling
+// thread only, which other processes disturb less than wall time does.
+// The other hardware counters are shown by dump, to help explain why a
+// config is better. If the kernel multiplexed the counters during a call,
+// its counts are scaled up to the whole call, and dump reports how many
+// calls that happened to. Without access to the counters, this falls back
+// to measuring wall time.
+class CycleCounts : public TotalExecutionTime {
+private:
+  bool HaveCounters;
+  std::array<bool, PC_NumCounters> Available = {};
+  ThreadSlots<CounterSums> Counters;
+
+public:
+  CycleCounts(double errPctBound = DEFAULT_STD_ERR_PCT)
+      : TotalExecutionTime(errPctBound),
+        HaveCounters(PerfCounters::supported()) {
+        FBK = FB_Cycles;
+
+        if (auto *PC = PerfCounters::forThread())
+          for (unsigned i = 0; i < PC_NumCounters; i++)
+            Available[i] = PC->available((PerfCounter) i);
+
+        if (HaveCounters)
+          Unit = "cycles";
+      }
+
+  TimePoint startMeasurement() override {
+    TimePoint Start = Clock::start();
+    if (HaveCounters)
+      if (auto *PC = PerfCounters::forThread())
+        PC->push(Start, PC->read());
+    return Start;
+  }
+
+  void endMeasurement(TimePoint Start) override {
+    if (!HaveCounters) {
+      record(Start);
+      return;
+    }
+
+    // a thread whose counters could not be opened is not measured.
+    auto *PC = PerfCounters::forThread();
+    if (!PC)
+      return;
+
+    auto After = PC->read();
+    auto End = Clock::stop();
+
+    auto Before = PC->pop(Start);
+    if (!Before)
+      return;
+
+    // a call during which the counters never ran tells nothing.
+    uint64_t Enabled = After.Enabled - Before->Enabled;
+    uint64_t Running = After.Running - Before->Running;
+    if (Running == 0)
+      return;
+
+    bool Scaled = Running < Enabled;
+    double Scale = Scaled ? (double) Enabled / Running : 1.0;
+
+    PerfCounters::Values Delta;
+    for (unsigned i = 0; i < PC_NumCounters; i++)
+      Delta[i] = (After.Counts[i] - Before->Counts[i]) * Scale;
+
+    std::chrono::duration<int64_t, std::nano> elapsedDur = (End - Start);
+
+    // the sample is the cycles per unit of work.
+    recordSample(End, elapsedDur.count(), Delta[PC_Cycles] / currentWorkload());
+    Counters.update([&](CounterSums &S) { S.add(Delta, Scaled); });
+  }
+
+  void dumpExtra(std::ostream &os) override {
+    if (!HaveCounters) {
+      JSON::output(os, "counters", "unavailable");
+      return;
+    }
+
+    uint64_t Calls = 0, Multiplexed = 0;
+    std::array<double, PC_NumCounters> Total = {};
+    Counters.forEach([&](CounterSums::Data const& S) {
+      Calls += S.Count;
+      Multiplexed += S.Multiplexed;
+      for (unsigned i = 0; i < PC_NumCounters; i++)
+        Total[i] += S.Sum[i];
+    });
+
+    if (Calls == 0)
+      return;
+
+    // the mean of each counter per call.
+    for (unsigned i = 0; i < PC_NumCounters; i++)
+      if (Available[i])
+        JSON::output(os, PerfCounterName((PerfCounter) i), Total[i] / Calls);
+
+    JSON::output(os, "multiplexed_calls", Multiplexed);
   }
 }; // end class
 
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+#include <tuner/Clock.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+
+namespace tuner {
+
+  enum PerfCounter {
+    PC_Cycles,
+    PC_Instructions,
+    PC_L1DMisses,
+    PC_LLCMisses,
+    PC_BranchMisses,
+    PC_NumCounters
+  };
+
+  static std::string PerfCounterName(PerfCounter PC) {
+    switch (PC) {
+      case PC_Cycles: return "cycles";
+      case PC_Instructions: return "instructions";
+      case PC_L1DMisses: return "l1d_misses";
+      case PC_LLCMisses: return "llc_misses";
+      case PC_BranchMisses: return "branch_misses";
+      default: throw std::runtime_error("unknown perf counter name");
+    }
+  }
+
+/////
+// the hardware performance counters of one thread, opened with
+// perf_event_open on the thread's first use. They are opened as one group,
+// led by the cycle counter, so that the kernel always schedules them
+// together. Where the kernel allows it, the group is read in user space
+// with rdpmc, through the pages that the kernel maps for its counters;
+// otherwise, with one read of the leader's file descriptor.
+//
+// Counters that cannot be opened, e.g., because of perf_event_paranoid, or
+// because the CPU lacks them, are simply unavailable. If the whole group
+// never gets onto the PMU at once, only the cycle counter is kept.
+class PerfCounters {
+public:
+  using Values = std::array<uint64_t, PC_NumCounters>;
+
+  // the counters, along with the time in ns that the group was enabled and
+  // actually counting. The two times only differ when the kernel had to
+  // multiplex the group with other events.
+  struct Reading {
+    Values Counts = {};
+    uint64_t Enabled = 0;
+    uint64_t Running = 0;
+  };
+
+  // the counters of the calling thread, or nullptr if not even
+  // the cycle counter is available.
+  static PerfCounters* forThread();
+
+  // whether the cycle counter can be opened in this process.
+  static bool supported();
+
+  PerfCounters();
+  ~PerfCounters();
+  PerfCounters(PerfCounters const&) = delete;
+  PerfCounters& operator=(PerfCounters const&) = delete;
+
+  bool available(PerfCounter PC) const {
+    return Fds_[PC] >= 0;
+  }
+
+  Reading read() const {
+    Reading R;
+    if (!readUser(R))
+      readGroup(R);
+    return R;
+  }
+
+  // remembers the counters at the start of a measurement, which is
+  // identified by its start time, since measurements may nest.
+  void push(Clock::time_point Start, Reading const& R) {
+    if (Depth_ < MaxDepth)
+      Stack_[Depth_++] = {Start, R};
+  }
+
+  // the counters at the start of the given measurement. Measurements that
+  // never ended, e.g., due to an exception, are dropped along the way.
+  std::optional<Reading> pop(Clock::time_point Start) {
+    while (Depth_ > 0) {
+      auto &Top = Stack_[--Depth_];
+      if (Top.first == Start)
+        return Top.second;
+    }
+    return std::nullopt;
+  }
+
+private:
+  static constexpr unsigned MaxDepth = 16;
+
+  int Fds_[PC_NumCounters];
+#ifdef __linux__
+  perf_event_mmap_page volatile* Pages_[PC_NumCounters];
+#endif
+
+  // the counters in the order of the group's values, leader first.
+  unsigned Order_[PC_NumCounters];
+  unsigned NumOpen_ = 0;
+
+  std::pair<Clock::time_point, Reading> Stack_[MaxDepth];
+  unsigned Depth_ = 0;
+
+  // reads the group through the leader's file descriptor.
+  void readGroup(Reading &R) const;
+
+  // closes every counter but the leader.
+  void closeMembers();
+
+  // reads the group in user space, which is only possible while all of
+  // its counters are on the PMU. Returns false if that is not the case.
+  bool readUser(Reading &R) const {
+#if defined(__linux__) && defined(__x86_64__)
+    auto *Lead = Pages_[PC_Cycles];
+    if (!Lead)
+      return false;
+
+    // the times come from the leader, which is scheduled with the group.
+    uint32_t Seq;
+    uint64_t Cyc = 0, Offset = 0;
+    uint32_t Mult = 0;
+    uint16_t Shift = 0;
+    bool UserTime;
+    do {
+      Seq = Lead->lock;
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+
+      R.Enabled = Lead->time_enabled;
+      R.Running = Lead->time_running;
+      UserTime = Lead->cap_user_time;
+      if (UserTime) {
+        Cyc = __builtin_ia32_rdtsc();
+        Offset = Lead->time_offset;
+        Mult = Lead->time_mult;
+        Shift = Lead->time_shift;
+      }
+
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    } while (Lead->lock != Seq);
+
+    if (!UserTime)
+      return false;
+
+    // the times above are as of the group's last schedule in, so the time
+    // since then, which the group spent counting, is added to both.
+    uint64_t Quot = Cyc >> Shift;
+    uint64_t Rem = Cyc & (((uint64_t) 1 << Shift) - 1);
+    uint64_t Delta = Offset + Quot * Mult + ((Rem * Mult) >> Shift);
+    R.Enabled += Delta;
+    R.Running += Delta;
+
+    for (unsigned k = 0; k < NumOpen_; k++) {
+      unsigned i = Order_[k];
+      auto *Page = Pages_[i];
+      if (!Page)
+        return false;
+
+      uint64_t Count;
+      bool InUser;
+      do {
+        Seq = Page->lock;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+
+        uint32_t Idx = Page->index;
+        Count = Page->offset;
+        InUser = Page->cap_user_rdpmc && Idx != 0;
+        if (InUser) {
+          // the raw value is sign-extended from the counter's width.
+          unsigned Width = Page->pmc_width;
+          int64_t Pmc = __builtin_ia32_rdpmc(Idx - 1);
+          Pmc <<= 64 - Width;
+          Pmc >>= 64 - Width;
+          Count += Pmc;
+        }
+
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+      } while (Page->lock != Seq);
+
+      if (!InUser)
+        return false;
+
+      R.Counts[i] = Count;
+    }
+
+    return true;
+#else
+    return false;
+#endif
+  }
+};
+
+} // end namespace
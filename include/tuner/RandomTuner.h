@@ -28,9 +28,10 @@ namespace tuner {
     GenResult& getNextConfig() override {
       KnobConfig KC;
 
-      // if this is the first requested config, we generate the default config.
+      // if this is the first requested config, we generate the default
+      // config, unless we were seeded with a better one.
       if (Configs_.empty())
-        KC = genDefaultConfig(KS_);
+        KC = initialConfig();
       else
         KC = genRandomConfig(KS_, Gen_);
 
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#include <tuner/Util.h>
+
+namespace tuner {
+
+/////
+// per-thread accumulators, so that threads recording data do not contend on
+// a lock or on a shared cache line. Each thread writes to its own slot, while
+// readers take a consistent snapshot of every slot through a sequence
+// counter, retrying if a write was in progress. A slot is allocated on the
+// first write of its thread.
+//
+// Threads beyond the first MaxThreads share one last slot, where writers
+// take turns.
+//
+// Acc must provide a snapshot() method that copies out its data.
+template<typename Acc, unsigned MaxThreads = 64>
+class ThreadSlots {
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> Seq{0}; // odd while a write is in progress.
+    Acc Data;
+  };
+
+  std::atomic<Slot*> Slots_[MaxThreads + 1] = {};
+  std::atomic<unsigned> Used_{0}; // one past the highest slot allocated.
+
+  Slot& local(unsigned Idx) {
+    Slot* S = Slots_[Idx].load(std::memory_order_acquire);
+    if (S)
+      return *S;
+
+    Slot* New = new Slot();
+    if (!Slots_[Idx].compare_exchange_strong(S, New, std::memory_order_acq_rel)) {
+      delete New;
+      return *S;
+    }
+
+    unsigned Used = Used_.load(std::memory_order_relaxed);
+    while (Used < Idx + 1 &&
+           !Used_.compare_exchange_weak(Used, Idx + 1, std::memory_order_release));
+    return *New;
+  }
+
+public:
+  using Snapshot = decltype(std::declval<Acc const&>().snapshot());
+
+  ThreadSlots() = default;
+  ThreadSlots(ThreadSlots const&) = delete;
+  ThreadSlots& operator=(ThreadSlots const&) = delete;
+
+  ~ThreadSlots() {
+    for (auto &S : Slots_)
+      delete S.load(std::memory_order_relaxed);
+  }
+
+  // applies Fn to the calling thread's accumulator.
+  template<typename Fn>
+  void update(Fn &&F) {
+    unsigned Idx = std::min(threadIndex(), MaxThreads);
+    Slot &S = local(Idx);
+
+    uint64_t Seq = S.Seq.load(std::memory_order_relaxed);
+    if (Idx < MaxThreads) {
+      S.Seq.store(Seq + 1, std::memory_order_relaxed);
+    } else {
+      do {
+        while (Seq & 1)
+          Seq = S.Seq.load(std::memory_order_relaxed);
+      } while (!S.Seq.compare_exchange_weak(Seq, Seq + 1,
+                                            std::memory_order_acquire,
+                                            std::memory_order_relaxed));
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    F(S.Data);
+
+    S.Seq.store(Seq + 2, std::memory_order_release);
+  }
+
+  // calls Fn with a consistent snapshot of each accumulator.
+  template<typename Fn>
+  void forEach(Fn &&F) const {
+    unsigned Used = Used_.load(std::memory_order_acquire);
+    for (unsigned i = 0; i <= MaxThreads; i++) {
+      if (i == Used)
+        i = MaxThreads;
+
+      Slot const* S = Slots_[i].load(std::memory_order_acquire);
+      if (!S)
+        continue;
+
+      while (true) {
+        uint64_t Before = S->Seq.load(std::memory_order_acquire);
+        if (Before & 1)
+          continue;
+
+        Snapshot Snap = S->Data.snapshot();
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (S->Seq.load(std::memory_order_relaxed) == Before) {
+          F(Snap);
+          break;
+        }
+      }
+    }
+  }
+};
+
+} // end namespace
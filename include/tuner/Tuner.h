@@ -7,7 +7,11 @@
 #include <llvm/IR/Module.h>
 
 #include <algorithm>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <vector>
 
 namespace tuner {
 
@@ -71,6 +75,18 @@ namespace tuner {
 
     KnobSet KS_;
     std::vector<GenResult> Configs_;
+    std::mutex ConfigLock_;
+
+    // produces a config to try first instead of the default one, such as
+    // the best config found by a prior run. It is only invoked once the
+    // tuner has analyzed the IR, so that it is aware of _all_ knobs.
+    std::function<KnobConfig(KnobSet const&)> Seeder_;
+
+    KnobConfig initialConfig() const {
+      if (Seeder_)
+        return Seeder_(KS_);
+      return genDefaultConfig(KS_);
+    }
 
   public:
 
@@ -84,6 +100,21 @@ namespace tuner {
     // NOTE: NOT THREAD SAFE.
     virtual GenResult& getNextConfig () = 0;
 
+    // produces a batch of at most Max configs to be compiled concurrently.
+    // The first config is always produced, and each additional one only if
+    // shouldCompileNext agrees. Unlike the methods it is built from, this
+    // one is thread safe.
+    std::vector<GenResult> getNextConfigs (size_t Max) {
+      std::lock_guard<std::mutex> Guard(ConfigLock_);
+      std::vector<GenResult> Batch;
+
+      Batch.push_back(getNextConfig());
+      while (Batch.size() < Max && shouldCompileNext())
+        Batch.push_back(getNextConfig());
+
+      return Batch;
+    }
+
     // a method to query whether the tuner
     // should produce a new config, given no
     // additional measurement feedback information
@@ -109,6 +140,17 @@ namespace tuner {
       applyToKnobs(ModifyModule, KS_);
     }
 
+    // must be called before the first config is requested.
+    void seed(std::function<KnobConfig(KnobSet const&)> Seeder) {
+      Seeder_ = std::move(Seeder);
+    }
+
+    // a thread safe version of bestSeen.
+    std::optional<GenResult> bestSeenSync() {
+      std::lock_guard<std::mutex> Guard(ConfigLock_);
+      return bestSeen();
+    }
+
     // NOTE: NOT THREAD SAFE
     std::optional<GenResult> bestSeen() const {
       std::optional<GenResult> best = std::nullopt;
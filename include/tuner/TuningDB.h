@@ -0,0 +1,57 @@
+#pragma once
+
+#include <easy/runtime/Context.h>
+#include <tuner/LoopKnob.h>
+
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace tuner {
+
+  // The best configuration found for one function + context, as it is
+  // stored in a TuningDB. KnobIDs are handed out in creation order, so they
+  // are not stable across processes. Instead, knobs are identified by a
+  // stable name (see Optimizer::knobName).
+  struct TuningRecord {
+    std::unordered_map<std::string, int> IntConfig;
+    std::unordered_map<std::string, LoopSetting> LoopConfig;
+    double ExpectedValue;
+  };
+
+  /////
+  // A human-readable file of tuning results that survives process restarts.
+  //
+  // Each line holds one record, with tab separated fields:
+  //
+  //    <key> <expected value> <knob name>=<value> ...
+  //
+  // where a loop knob's value is a comma separated list of its settings,
+  // with "-" marking a setting that is not present.
+  //
+  // All methods are thread safe.
+  class TuningDB {
+    std::string Path_;
+    std::unordered_map<std::string, TuningRecord> Records_;
+    mutable std::mutex Lock_;
+
+  public:
+    // loads the records in the given file, if it exists.
+    TuningDB(std::string Path);
+
+    std::optional<TuningRecord> lookup(std::string const& Key) const;
+
+    // replaces any existing record for the key.
+    void update(std::string const& Key, TuningRecord Rec);
+
+    // writes all records back to the file.
+    void save() const;
+
+    // the key under which a function's results are stored. Pointer
+    // arguments are only recorded as such, since their values differ
+    // from run to run.
+    static std::string makeKey(std::string const& FunName, easy::Context const& Cxt);
+  };
+
+} // end namespace
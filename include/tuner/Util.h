@@ -12,12 +12,50 @@
 
 #define BEST_SWAP_ENABLE        true
 
+// the number of non-best versions kept per function + context.
+#define DEFAULT_RETAINED_VERSIONS   8
+
 // GROWTH_RATE * 100 = percent
 #define EXPERIMENT_DEPLOY_GROWTH_RATE     0.2
 #define EXPERIMENT_MIN_DEPLOY_NS          50'000
 
+// while the best version is served, whether to experiment again is only
+// reconsidered every SERVE_CHECK_PERIOD calls on average (a power of 2).
+#define SERVE_CHECK_PERIOD                64
+
+// the number of recent lookups each thread remembers per ATDriver, so that a
+// hit in reoptimize does not touch the shared state map (a power of 2).
+#define LOOKUP_CACHE_SIZE                 64
+
+// the window over which the compile time of an ExperimentBudget is limited.
+#define EXPERIMENT_BUDGET_WINDOW_S        60
+
 #define PREFERRED_FEEDBACK  FB_Total
 
+// the significance level at which Feedback::betterThan concludes that
+// one version is faster than another, by at least the given fraction.
+#define BETTER_THAN_ALPHA   0.05
+#define BETTER_THAN_MARGIN  0.02
+
+// a trial is abandoned before its statistics are good once, with at least
+// ABANDON_MIN_SAMPLES measurements, the best version is faster by at least
+// ABANDON_MARGIN at significance level ABANDON_ALPHA. This test is repeated
+// as the trial's samples come in, so its level is much stricter.
+#define ABANDON_ALPHA       0.001
+#define ABANDON_MARGIN      0.1
+#define ABANDON_MIN_SAMPLES 3
+
+// see tuner::summarizeRobust
+#define OUTLIER_MADS        3.5
+#define TRIM_FRACTION       0.1
+
+// once its statistics are good, FB_Sampled measures about this many calls
+// per second, and at least 1 in SAMPLE_MAX_PERIOD calls. Each thread adapts
+// the rate after every SAMPLE_ADAPT_EVERY calls that it measures.
+#define SAMPLE_TARGET_PER_SEC   1'000
+#define SAMPLE_MAX_PERIOD       1'024
+#define SAMPLE_ADAPT_EVERY      64
+
 namespace tuner {
   // a "missing" value indicator
   static constexpr float MISSING = std::numeric_limits<float>::quiet_NaN();
@@ -58,4 +96,8 @@ namespace tuner {
   // sleeps the current thread
   void sleep_for(unsigned ms);
 
+  // a small index for the current thread, which is unique among the threads
+  // that are alive. The index of a thread that has exited is reused.
+  unsigned threadIndex();
+
 } // end namespace tuner
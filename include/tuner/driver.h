@@ -7,194 +7,579 @@
 
 #include <easy/jit.h>
 #include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <list>
+#include <tuple>
+#include <array>
+#include <functional>
+#include <string>
+#include <type_traits>
 
 #include <tuner/optimizer.h>
 #include <tuner/Util.h>
 #include <tuner/JSON.h>
+#include <tuner/Epochs.h>
 
 namespace tuner {
 
   namespace {
+    // integers are grouped into size classes by their magnitude: class 0
+    // holds 0, and class k holds the values in [2^(k-1), 2^k).
+    constexpr unsigned NumSizeClasses = 65;
+
+    template<class T>
+    unsigned sizeClass(T const& Val) {
+      if constexpr (std::is_integral_v<T>) {
+        uint64_t Mag = Val < 0 ? -(uint64_t) Val : (uint64_t) Val;
+        return Mag == 0 ? 0 : 64 - __builtin_clzll(Mag);
+      } else {
+        return 0;
+      }
+    }
+
+    // the size class of the Pos-th argument (counting from 1).
+    template<class ... Args>
+    unsigned sizeClassOf(unsigned Pos, Args const& ... args) {
+      unsigned Class = 0, i = 0;
+      ((++i == Pos ? (Class = sizeClass(args), 0) : 0), ...);
+      return Class;
+    }
+
+    // marks a published version as the trial, or as final, i.e., it will
+    // be served for as long as the entry lives, and there is nothing to
+    // decide or measure about it. Versions are heap allocated, so the two
+    // lowest bits of their address are free.
+    constexpr uintptr_t TrialBit = 1;
+    constexpr uintptr_t FinalBit = 2;
+
+    inline easy::FunctionWrapperBase* versionOf(uintptr_t Published) {
+      return reinterpret_cast<easy::FunctionWrapperBase*>(Published & ~(TrialBit | FinalBit));
+    }
+
     struct OptimizationInfo {
-      OptimizationInfo(std::unique_ptr<tuner::Optimizer> Opt_)
-          : Opt(std::move(Opt_)),
-            Trial(easy::FunctionWrapperBase()),
-            Best(easy::FunctionWrapperBase()) {}
+      OptimizationInfo(std::unique_ptr<tuner::Optimizer> Opt_,
+                       std::shared_ptr<tuner::ExperimentBudget> Budget_ = nullptr)
+          : Opt(std::move(Opt_)), Budget(std::move(Budget_)) {}
 
       std::unique_ptr<tuner::Optimizer> Opt;
-      easy::FunctionWrapperBase Trial;
-      easy::FunctionWrapperBase Best;
-      std::vector<easy::FunctionWrapperBase> Others;
+
+      // shared by all entries of the driver, if it has one.
+      std::shared_ptr<tuner::ExperimentBudget> Budget;
+
+      // Each version lives on the heap, so the reference handed out by
+      // reoptimize stays valid while other threads promote or swap versions.
+      std::unique_ptr<easy::FunctionWrapperBase> Trial;
+      std::unique_ptr<easy::FunctionWrapperBase> Best;
+      std::vector<std::unique_ptr<easy::FunctionWrapperBase>> Others;
+
+      // versions that can no longer be served, along with the epoch they
+      // were retired in, or 0 until the next publish. They are freed once
+      // no thread can still be running them (see tuner::Epochs).
+      std::deque<std::pair<uint64_t,
+                           std::unique_ptr<easy::FunctionWrapperBase>>> Retired;
+
+      // The version currently being served, which is either the Trial or
+      // the Best, tagged with TrialBit if it is the Trial, or FinalBit if
+      // it is final. Both go in one word, so that a reader never pairs a
+      // version with the flags of another. It is only written while holding the Lock, but it is
+      // read without it.
+      std::atomic<uintptr_t> Published = 0;
+      std::atomic<bool> HaveOthers = false;
+
+      // held while deciding what to serve next, i.e., when a trial is
+      // started, promoted, or the best version is swapped out.
+      std::mutex Lock;
 
       // Recurrence where n corresponds to the value of FullExperiments.
       // Thresh(0) = MinDeploy
       // Thresh(n) = Thresh(n-1) + GrowthFactor * Thresh(n-1)
-      double DeploymentThresh = EXPERIMENT_MIN_DEPLOY_NS;
+      std::atomic<double> DeploymentThresh = EXPERIMENT_MIN_DEPLOY_NS;
+
+      // the deployed time, in ns, of the versions tried in experiments, and
+      // that of the best versions so far, not counting the current best.
+      std::atomic<uint64_t> TrialTime = 0;
+      std::atomic<uint64_t> BestTime = 0;
 
       // statistics
-      uint64_t Requests = 0; // total requests to reoptimize this function
-      uint64_t FullExperiments = 0; // total full (jit) experiments performed
-      uint64_t FastExperiments = 0; // total quick swap experiments performed.
-      uint64_t BestSwaps = 0; // total number of actual swaps in Fast experiment
+      std::atomic<uint64_t> Requests = 0; // total requests to reoptimize this function, estimated
+      std::atomic<uint64_t> FullExperiments = 0; // total full (jit) experiments performed
+      std::atomic<uint64_t> FastExperiments = 0; // total quick swap experiments performed.
+      std::atomic<uint64_t> BestSwaps = 0; // total number of actual swaps in Fast experiment
+      std::atomic<uint64_t> Evictions = 0; // total versions evicted from Others
+      std::atomic<uint64_t> Abandoned = 0; // total trials stopped early for being worse
+
+      // used to decide which entry the driver should evict, if any.
+      std::atomic<bool> Referenced = false; // looked up since the hand passed
+      std::atomic<bool> Bound = false;      // a TunedFunction refers to it
+
+      // with dispatch_on, calls through a TunedFunction are served by a
+      // separate entry for each size class of the chosen argument. These
+      // are created on first use, under the Lock, and live as long as
+      // this entry.
+      unsigned DispatchOn = 0;
+      std::function<std::unique_ptr<tuner::Optimizer>()> MakeClassOpt;
+      std::array<std::atomic<OptimizationInfo*>, NumSizeClasses> Classes = {};
+      std::vector<std::unique_ptr<OptimizationInfo>> ClassStore;
     };
   }
 
+/////
+// A persistent handle to a function being tuned by an ATDriver, obtained
+// from ATDriver::bind. Calling the handle invokes the version the driver is
+// currently serving, and tuning decisions are still made behind it, exactly
+// as if reoptimize were called before every call.
+//
+// Unlike reoptimize, no easy::Context is built, hashed, or looked up per call.
+// Once the version being served is final, e.g., when there is no tuner, a
+// call is just an atomic load and a direct call to that version.
+// A handle is cheap to copy and remains valid for the lifetime of its driver,
+// since the driver never evicts an entry that has been bound.
+template<class WrapperTy>
+class TunedFunction {
+  OptimizationInfo *Info_;
+
+  public:
+  TunedFunction(OptimizationInfo &Info) : Info_(&Info) {}
+
+  // the version that would be used by the next call.
+  WrapperTy const& get() const;
+
+  // the version that would be used by the next call with these arguments,
+  // which differs from get() when dispatching on an argument.
+  template<class ... Args>
+  WrapperTy const& select(Args const& ... args) const;
+
+  template<class ... Args>
+  decltype(auto) operator()(Args&& ... args) const;
+};
+
+/////
+// The autotuning driver. It is safe for multiple threads to call
+// reoptimize concurrently, whether on the same function + context or not.
+//
+// In the common case, reoptimize only performs a lookup in a small cache
+// owned by the calling thread and a handful of atomic loads to return the
+// version being served. The shared state map is only searched, under a
+// shared lock, when that cache misses. Threads only synchronize on a per-function lock
+// when a decision must be made, and if another thread is already making
+// that decision, the currently published version is returned instead of
+// waiting.
 class ATDriver {
-  using Key = std::pair<void*, std::shared_ptr<easy::Context>>;
+  using Key = std::pair<void*, easy::Context>;
   using Entry = OptimizationInfo;
 
-  using iterator = typename std::unordered_map<Key, Entry>::iterator;
+  // a lookup remembered by a thread. It is only valid while the driver's
+  // Generation_ is unchanged, since entries are never removed without
+  // bumping it.
+  struct LookupSlot {
+    uint64_t Driver = 0;
+    uint64_t Generation = 0;
+    size_t Hash = 0;
+    Key const* K = nullptr;
+    Entry* Info = nullptr;
+  };
 
   protected:
-  std::unordered_map<Key, Entry> DriverState_;
+  std::unordered_map<Key, std::unique_ptr<Entry>> DriverState_;
+  mutable std::shared_mutex StateLock_; // protects the structure of DriverState_
+
+  // the maximum number of entries kept, where 0 means unbounded.
+  std::atomic<size_t> MaxEntries_ = 0;
+  std::atomic<uint64_t> EntryEvictions_ = 0;
+
+  // the entries of DriverState_ in a ring, for the CLOCK algorithm. The
+  // hand points at the next entry to consider for eviction, and new
+  // entries are placed right behind it. Both are protected by StateLock_.
+  std::list<std::pair<Key const*, Entry*>> Clock_;
+  std::list<std::pair<Key const*, Entry*>>::iterator Hand_ = Clock_.end();
+
+  // tells apart the drivers in the threads' lookup caches.
+  static inline std::atomic<uint64_t> NextId_ = 1;
+  const uint64_t Id_ = NextId_++;
+
+  // bumped whenever an entry is removed from DriverState_, which
+  // invalidates every lookup the threads remembered. It is only written
+  // while holding StateLock_ exclusively, and it does not share a line
+  // with the lock, so that reading it on every lookup contends with nothing.
+  alignas(64) std::atomic<uint64_t> Generation_ = 0;
+
+  // entries evicted from DriverState_, along with the epoch they were
+  // retired in. Like evicted versions, they are only freed once no thread
+  // can still be serving them.
+  std::vector<std::pair<uint64_t, std::unique_ptr<Entry>>> RetiredEntries_;
+
+  // where tuning results are persisted, if anywhere.
+  std::shared_ptr<tuner::TuningDB> DB_;
+
+  // limits the cost of experiments across all entries.
+  std::shared_ptr<tuner::ExperimentBudget> Budget_ = std::make_shared<tuner::ExperimentBudget>();
+
+  template<class WrapperTy>
+  friend class TunedFunction;
+
+  // marks the entry as used. The bit is only written when it is clear, so
+  // that the lookups of an entry in use mostly just read it.
+  Entry& touch(Entry &E, bool Bind) {
+    if (MaxEntries_.load(std::memory_order_relaxed) > 0
+        && !E.Referenced.load(std::memory_order_relaxed))
+      E.Referenced.store(true, std::memory_order_relaxed);
+    if (Bind)
+      E.Bound.store(true, std::memory_order_relaxed);
+    return E;
+  }
 
-  public:
-  ATDriver() {}
-  ~ATDriver() {}
+  // makes room for one more entry by retiring entries that were not used
+  // recently, and moves the retired entries that are safe to free into Doomed.
+  // Must be called while holding StateLock_ exclusively.
+  void evictEntries(std::vector<std::unique_ptr<Entry>> &Doomed) {
+    for (auto It = RetiredEntries_.begin(); It != RetiredEntries_.end(); ) {
+      if (tuner::Epochs::quiescent(It->first)) {
+        Doomed.push_back(std::move(It->second));
+        It = RetiredEntries_.erase(It);
+      } else {
+        ++It;
+      }
+    }
 
-  void exportStats() {
-    exportStats(std::cout);
+    size_t Max = MaxEntries_.load();
+    if (Max == 0)
+      return;
+
+    while (DriverState_.size() >= Max) {
+      // the hand clears the bits of the entries used since it last passed
+      // them, and stops at the first one that was not. Two turns around
+      // the ring are enough, unless every entry is bound.
+      auto Victim = DriverState_.end();
+      for (size_t Steps = 0; Steps < 2 * Clock_.size(); Steps++) {
+        if (Hand_ == Clock_.end())
+          Hand_ = Clock_.begin();
+
+        Entry &E = *Hand_->second;
+        if (E.Bound) {
+          ++Hand_;
+        } else if (E.Referenced.load(std::memory_order_relaxed)) {
+          E.Referenced.store(false, std::memory_order_relaxed);
+          ++Hand_;
+        } else {
+          Victim = DriverState_.find(*Hand_->first);
+          Hand_ = Clock_.erase(Hand_);
+          break;
+        }
+      }
+
+      if (Victim == DriverState_.end())
+        return; // every entry is bound.
+
+      // what was learned about this function + context is not lost.
+      if (DB_)
+        forEachClass(*Victim->second, [&](Entry &E) { E.Opt->saveTuning(*DB_); });
+
+      auto Evicted = std::move(Victim->second);
+      DriverState_.erase(Victim);
+
+      // no thread may find it through its lookup cache from now on. The
+      // threads that already did are pinned to an epoch before this one.
+      Generation_.fetch_add(1);
+      RetiredEntries_.emplace_back(tuner::Epochs::retire(), std::move(Evicted));
+      EntryEvictions_ += 1;
+    }
   }
 
-  // std::filesystem not available in GCC 7
-  void exportStats(std::string out) {
-    std::ofstream file;
-    // if the file already exists, we try to find a new file name for the data.
-    // TODO
-    file.open(out, std::ios::out | std::ios::trunc);
+  // the calling thread's recent lookups, shared by all drivers.
+  static std::array<LookupSlot, LOOKUP_CACHE_SIZE>& lookupCache() {
+    static thread_local std::array<LookupSlot, LOOKUP_CACHE_SIZE> Cache;
+    return Cache;
+  }
 
-    exportStats(file);
-    file.close();
+  // remembers where K was found. Must be called while holding StateLock_,
+  // so that Generation_ cannot change until the entry is reachable.
+  void remember(LookupSlot &Slot, size_t Hash, Key const& K, Entry &E) {
+    Slot.Driver = Id_;
+    Slot.Generation = Generation_.load();
+    Slot.Hash = Hash;
+    Slot.K = &K;
+    Slot.Info = &E;
   }
 
-  void exportStats(std::ostream& file) {
-    // formatting preferences
-    file << std::setprecision(10);
+  // finds the entry for the given key. If it does not exist, the entry is
+  // produced by MakeEntry, which is only invoked in that case.
+  //
+  // Unless binding, the caller must be pinned to an epoch, since an entry
+  // found in the lookup cache may be evicted at any time. Binding always
+  // goes through the state map, where an entry cannot be evicted while it
+  // is being bound.
+  template<class EntryFactory>
+  Entry& lookup(Key const& K, EntryFactory &&MakeEntry, bool Bind) {
+    size_t Hash = std::hash<Key>{}(K);
+    LookupSlot &Slot = lookupCache()[Hash & (LOOKUP_CACHE_SIZE - 1)];
+
+    if (!Bind && Slot.Driver == Id_ && Slot.Hash == Hash
+        && Slot.Generation == Generation_.load() && *Slot.K == K)
+      return touch(*Slot.Info, Bind);
+
+    {
+      std::shared_lock<std::shared_mutex> Reader(StateLock_);
+      auto Found = DriverState_.find(K);
+      if (Found != DriverState_.end()) {
+        remember(Slot, Hash, Found->first, *Found->second);
+        return touch(*Found->second, Bind);
+      }
+    }
 
-    JSON::beginArray(file);
-    bool pastFirst = false;
-    for (auto const &State : DriverState_) {
-      const Key &K = State.first;
-      const Entry &E = State.second;
+    // entries are freed after releasing the lock, since an optimizer's
+    // destructor waits for its compile jobs to finish.
+    std::vector<std::unique_ptr<Entry>> Doomed;
+    std::unique_lock<std::shared_mutex> Writer(StateLock_);
+
+    // someone may have beaten us to it while we waited for the lock.
+    auto Found = DriverState_.find(K);
+    if (Found != DriverState_.end()) {
+      remember(Slot, Hash, Found->first, *Found->second);
+      return touch(*Found->second, Bind);
+    }
+
+    evictEntries(Doomed);
+
+    auto EmplaceResult = DriverState_.try_emplace(K, MakeEntry());
+    Key const &NewKey = EmplaceResult.first->first;
+    Entry &New = *EmplaceResult.first->second;
+
+    // a new entry is not marked as used, but the hand only reaches it
+    // after every other entry.
+    Clock_.insert(Hand_, { &NewKey, &New });
+    if (Bind)
+      New.Bound.store(true, std::memory_order_relaxed);
 
-      if (pastFirst)
-        JSON::comma(file);
+    remember(Slot, Hash, NewKey, New);
+    return New;
+  }
 
-      pastFirst |= true;
+  static easy::FunctionWrapperBase* compileVersion(tuner::Optimizer &Opt) {
+    auto Compiled = Opt.recompile();
+    return new easy::FunctionWrapperBase(std::move(Compiled.first),
+                                         std::move(Compiled.second));
+  }
 
-      JSON::beginObject(file);
+  static easy::FunctionWrapperBase& publish(Entry &Info, easy::FunctionWrapperBase &FW) {
+    uintptr_t Tagged = reinterpret_cast<uintptr_t>(&FW);
 
-      JSON::output(file, "requests", E.Requests);
-      JSON::output(file, "experiments", E.FullExperiments);
-      JSON::output(file, "fast_experiments", E.FastExperiments);
-      JSON::output(file, "best_swaps", E.BestSwaps);
-      JSON::output(file, "deploy_thresh", E.DeploymentThresh);
+    // without a tuner, the first version is the only one there will be.
+    if (Info.Opt->isNoopTuner())
+      Tagged |= FinalBit;
+    else if (&FW == Info.Trial.get())
+      Tagged |= TrialBit;
 
-      E.Opt->dumpStats(file);
+    Info.Published.store(Tagged, std::memory_order_release);
 
-      JSON::endObject(file);
+    // what was retired before this point is no longer reachable.
+    if (!Info.Retired.empty() && Info.Retired.back().first == 0) {
+      uint64_t Epoch = tuner::Epochs::retire();
+      for (auto It = Info.Retired.rbegin(); It != Info.Retired.rend() && It->first == 0; ++It)
+        It->first = Epoch;
     }
-    JSON::endArray(file);
+
+    return FW;
   }
 
-  template<class T, class ... Args>
-  auto const& EASY_JIT_COMPILER_INTERFACE reoptimize(T &&Fun, Args&& ... args) {
-    void* FunPtr = reinterpret_cast<void*>(easy::meta::get_as_pointer(Fun));
-    using wrapper_ty = decltype(easy::jit(std::forward<T>(Fun), std::forward<Args>(args)...));
+  // whether the budget allows another experiment, where BestDeployed is the
+  // time the current best version has been deployed for.
+  static bool withinBudget(Entry &Info, uint64_t BestDeployed) {
+    if (!Info.Budget)
+      return true;
 
-    std::shared_ptr<easy::Context> Cxt = easy::get_sharable_context_for<T, Args...>(std::forward<Args>(args)...);
+    return Info.Budget->trialAllowed(Info.TrialTime, Info.BestTime + BestDeployed)
+        && Info.Budget->compileAllowed();
+  }
 
-    auto Opt = std::make_unique<tuner::Optimizer>(FunPtr, Cxt, /*LazyInit=*/true);
+  // decides whether the best version should be served without experimenting.
+  static bool shouldReturnBest(Entry &Info, bool DeployedLongEnough) {
+    tuner::Optimizer &Opt = *(Info.Opt);
+    bool Impatient = !(Opt.getContext()->waitForCompile());
 
-    std::pair<iterator, bool> EmplaceResult =
-            DriverState_.emplace(Key(FunPtr, Cxt),
-                                 OptimizationInfo(std::move(Opt)));
+    if (Opt.isNoopTuner())
+      return true;
 
+    // should we return the current best or not, based on our patience.
+    if (Impatient) {
+      if (!DeployedLongEnough)
+        return true; // no experiment => return best
 
-    // pull out data from the emplace
-    Key const &KeyVals = EmplaceResult.first->first;
-    Entry &Info = EmplaceResult.first->second;
+      return Opt.status() == opt_status::Working; // we're not going to wait
+    }
 
-    tuner::Optimizer &OptFromEntry = *(Info.Opt);
-    easy::FunctionWrapperBase &Trial = Info.Trial;
-    easy::FunctionWrapperBase &Best = Info.Best;
+    return false;
+  }
+
+  // the lock-free path: returns the published version if no decision
+  // needs to be made right now, otherwise nullptr.
+  static easy::FunctionWrapperBase* tryServePublished(Entry &Info) {
+    uintptr_t Published = Info.Published.load(std::memory_order_acquire);
+
+    if (Published == 0 || (Published & TrialBit))
+      return nullptr;
+
+    easy::FunctionWrapperBase* Current = versionOf(Published);
+    if (Published & FinalBit)
+      return Current;
+
+    // otherwise, the published version is the best one, and the checks
+    // below only change their minds as time passes and measurements come
+    // in. Summing its deployed time over the threads' slots is too costly
+    // for every call, so they are only made once in a while.
+    if ((sampleBits() & (SERVE_CHECK_PERIOD - 1)) != 0)
+      return Current;
+
+    // this call stands for those that skipped the checks.
+    Info.Requests.fetch_add(SERVE_CHECK_PERIOD, std::memory_order_relaxed);
+
+    uint64_t Deployed = Current->getFeedback().getDeployedTime();
+    bool deployedLongEnough = Deployed >= Info.DeploymentThresh;
+
+    bool WantExperiment = !shouldReturnBest(Info, deployedLongEnough)
+        || (BEST_SWAP_ENABLE && deployedLongEnough && Info.HaveOthers);
+
+    // while the budget is used up, no experiments of any kind are made.
+    if (WantExperiment && withinBudget(Info, Deployed))
+      return nullptr;
+
+    return Current;
+  }
+
+  // keeps at most the configured number of other versions by retiring
+  // the worst performing ones. Must be called while holding Info.Lock.
+  static void evictOthers(Entry &Info) {
     auto &Others = Info.Others;
+    size_t Max = Info.Opt->getContext()->getRetainedVersions();
 
-    bool Impatient = !(OptFromEntry.getContext()->waitForCompile());
-    bool WasNotInCache = EmplaceResult.second;
+    while (Others.size() > Max) {
+      size_t Worst = 0;
+      for (size_t i = 1; i < Others.size(); i++)
+        if (Others[Worst]->getFeedback().betterThan(Others[i]->getFeedback()))
+          Worst = i;
 
-    Info.Requests += 1;
+      Info.Retired.emplace_back(0, std::move(Others[Worst]));
+      Others.erase(Others.begin() + Worst);
+      Info.Evictions += 1;
+    }
+  }
+
+  // whether the trial is so clearly worse than the best version that
+  // measuring it further is not worth the cost to the callers.
+  // Must be called while holding Info.Lock.
+  static bool shouldAbandon(Entry &Info) {
+    if (!Info.Best)
+      return false;
+
+    auto &TrialFB = Info.Trial->getFeedback();
+    if (TrialFB.sampleSize() < ABANDON_MIN_SAMPLES)
+      return false;
+
+    return Info.Best->getFeedback().betterThan(TrialFB, ABANDON_ALPHA, ABANDON_MARGIN);
+  }
+
+  // frees the retired versions that no thread can be running anymore.
+  // Must be called while holding Info.Lock.
+  static void freeRetired(Entry &Info) {
+    while (!Info.Retired.empty()) {
+      uint64_t Epoch = Info.Retired.front().first;
+      if (Epoch == 0 || !tuner::Epochs::quiescent(Epoch))
+        return;
+      Info.Retired.pop_front();
+    }
+  }
+
+  // the slow path, which must be called while holding Info.Lock.
+  static easy::FunctionWrapperBase& decide(Entry &Info) {
+    tuner::Optimizer &OptFromEntry = *(Info.Opt);
+    auto &Trial = Info.Trial;
+    auto &Best = Info.Best;
+    auto &Others = Info.Others;
 
-    ////////
-    // decide whether to recompile or not.
+    freeRetired(Info);
 
-    if (WasNotInCache) {
+    if (!Trial && !Best) {
       // this is the first encounter of the function + context
       // we must submit a compilation job
       OptFromEntry.initialize();
-      Trial = easy::jit_with_optimizer<T, Args...>(OptFromEntry, std::forward<T>(Fun));
-      return reinterpret_cast<wrapper_ty&>(Trial);
+      Trial.reset(compileVersion(OptFromEntry));
+      return publish(Info, *Trial);
     }
 
     // Check if the trial version is done.
-    if (!Trial.isEmpty()) {
-        Trial.getFeedback().updateStats();
-        if (Trial.getFeedback().goodQuality()) {
+    if (Trial) {
+        Trial->getFeedback().updateStats();
+
+        // the first version is not an experiment.
+        uint64_t Spent = Best ? Trial->getFeedback().getDeployedTime() : 0;
+
+        if (Trial->getFeedback().goodQuality()) {
+          Info.TrialTime += Spent;
           auto MaybeGood = std::move(Trial);
-          Trial = easy::FunctionWrapperBase(); // erase the trial field
 
           // Check to see which is better
-          if (Best.isEmpty() || MaybeGood.getFeedback()
+          if (!Best || MaybeGood->getFeedback()
                                 .betterThan(
-                                Best.getFeedback())) {
+                                Best->getFeedback())) {
+            if (Best)
+              Others.push_back(std::move(Best));
             Best = std::move(MaybeGood);
           } else {
             Others.push_back(std::move(MaybeGood));
           }
-      }
+          evictOthers(Info);
+          Info.HaveOthers = !Others.empty();
+        } else if (shouldAbandon(Info)) {
+          // serve the best version again. The trial may still be running
+          // in other threads, so it is retired. It is only stamped with an
+          // epoch once the next publish makes it unreachable, and only
+          // freed once every thread that may have obtained it moved on.
+          Info.TrialTime += Spent;
+          Trial->getFeedback().abandon();
+          Info.Retired.emplace_back(0, std::move(Trial));
+          Info.Abandoned += 1;
+        }
     }
 
     // if we are we still evaluating a trial version, return it.
-    if (!Trial.isEmpty())
-      return reinterpret_cast<wrapper_ty&>(Trial);
+    if (Trial)
+      return publish(Info, *Trial);
 
-    assert(!Best.isEmpty() && "logic error!");
+    assert(Best && "logic error!");
 
     ///////////
     // otherwise, we're free to make a decision on whether to
     // experiment again, or make use of the best version so far.
 
-    bool deployedLongEnough = Best.getFeedback().getDeployedTime() >= Info.DeploymentThresh;
-    bool isNoopTuner = OptFromEntry.isNoopTuner();
-    bool shouldReturnBest = isNoopTuner;
+    uint64_t Deployed = Best->getFeedback().getDeployedTime();
+    bool deployedLongEnough = Deployed >= Info.DeploymentThresh;
+    bool Allowed = withinBudget(Info, Deployed);
 
-    // should we return the current best or not, based on our patience.
-    if (!shouldReturnBest && Impatient) {
-      if (OptFromEntry.status() == opt_status::Working)
-        shouldReturnBest = true; // we're not going to wait
-      else
-        shouldReturnBest = !deployedLongEnough; // no experiment => return best
-    }
-
-    if (!shouldReturnBest) {
+    if (Allowed && !shouldReturnBest(Info, deployedLongEnough)) {
       ////////////
       // that means we should experiment by obtaining a totally new version!
+      // It is compiled first, since that may throw, in which case nothing
+      // below has happened and the best version is still being served.
+      Trial.reset(compileVersion(OptFromEntry));
 
       // reset Best's deployment time, since we crossed the limit here.
-      Best.getFeedback().resetDeployedTime();
+      Info.BestTime += Deployed;
+      Best->getFeedback().resetDeployedTime();
 
       // raise the deployment threshold
       Info.FullExperiments += 1;
-      Info.DeploymentThresh += Info.DeploymentThresh * EXPERIMENT_DEPLOY_GROWTH_RATE;
+      Info.DeploymentThresh = Info.DeploymentThresh * (1.0 + EXPERIMENT_DEPLOY_GROWTH_RATE);
 
-      Trial = easy::jit_with_optimizer<T, Args...>(OptFromEntry, std::forward<T>(Fun));
-      return reinterpret_cast<wrapper_ty&>(Trial);
+      return publish(Info, *Trial);
     }
 
     ///////////
     // otherwise, quickly return the best version since we don't want to wait.
 
-    if (BEST_SWAP_ENABLE && deployedLongEnough && Others.size() > 0) {
+    if (BEST_SWAP_ENABLE && Allowed && deployedLongEnough && Others.size() > 0) {
       // We would have experimented, but we were impatient.
       // Next best thing to do is quickly recheck whether the current
       // "best" version is still actually the best, since extensive usage
@@ -202,12 +587,12 @@ class ATDriver {
 
       Info.FastExperiments += 1;
 
-      auto &bestFB = Best.getFeedback();
+      auto &bestFB = Best->getFeedback();
       size_t othersBestIdx = ~0;
 
       for (size_t i = 0; i < Others.size(); i++) {
         auto &Old = Others[i];
-        auto &oldFB = Old.getFeedback();
+        auto &oldFB = Old->getFeedback();
         if (oldFB.betterThan(bestFB)){
           othersBestIdx = i;
         }
@@ -219,22 +604,302 @@ class ATDriver {
 #ifndef NDEBUG
         std::cerr << "best = " << bestFB.expectedValue()
                   << ", othersBest[" << othersBestIdx << "] = "
-                  << Others[othersBestIdx].getFeedback().expectedValue()
+                  << Others[othersBestIdx]->getFeedback().expectedValue()
                   << ". swapping" << std::endl;
 #endif
-        auto OldBest = std::move(Best);
-        Best = std::move(Others[othersBestIdx]);
-        Best.getFeedback().resetDeployedTime();
-        Others[othersBestIdx] = std::move(OldBest);
+        Info.BestTime += bestFB.getDeployedTime();
+        std::swap(Best, Others[othersBestIdx]);
+        Best->getFeedback().resetDeployedTime();
       }
     } // end of check others for best
 
     /////
     // finally, return the best version!
-    return reinterpret_cast<wrapper_ty&>(Best);
+    return publish(Info, *Best);
+  }
+
+  // the entry for the given size class, which is created if needed. A new
+  // class starts from the best config of the nearest class that has one.
+  static Entry& classEntry(Entry &Info, unsigned Class) {
+    if (Entry *E = Info.Classes[Class].load(std::memory_order_acquire))
+      return *E;
+
+    std::lock_guard<std::mutex> Guard(Info.Lock);
+    if (Entry *E = Info.Classes[Class].load(std::memory_order_relaxed))
+      return *E;
+
+    auto New = std::make_unique<Entry>(Info.MakeClassOpt(), Info.Budget);
+    New->Opt->setVariant(";size_class=" + std::to_string(Class));
+
+    for (unsigned Dist = 1; Dist < NumSizeClasses; Dist++) {
+      std::optional<TuningRecord> Rec;
+      for (int Near : { (int) Class - (int) Dist, (int) Class + (int) Dist }) {
+        if (Near < 0 || Near >= (int) NumSizeClasses || Rec)
+          continue;
+        if (Entry *E = Info.Classes[Near].load(std::memory_order_relaxed))
+          Rec = E->Opt->bestRecord();
+      }
+
+      if (Rec) {
+        New->Opt->seedWith(Rec.value());
+        break;
+      }
+    }
+
+    Entry &E = *New;
+    Info.ClassStore.push_back(std::move(New));
+    Info.Classes[Class].store(&E, std::memory_order_release);
+    return E;
+  }
+
+  // calls F on the entry and each of its size classes.
+  template<class Fn>
+  static void forEachClass(Entry &Info, Fn &&F) {
+    F(Info);
+    for (auto &Class : Info.Classes)
+      if (Entry *E = Class.load(std::memory_order_acquire))
+        F(*E);
+  }
+
+  static easy::FunctionWrapperBase& serve(Entry &Info) {
+    if (auto *Ready = tryServePublished(Info))
+      return *Ready;
+
+    Info.Requests.fetch_add(1, std::memory_order_relaxed);
+
+    std::unique_lock<std::mutex> Guard(Info.Lock, std::defer_lock);
+
+    if (Info.Published.load(std::memory_order_acquire) == 0) {
+      // nothing to serve yet, so we must wait for whoever
+      // is compiling the first version, or compile it ourselves.
+      Guard.lock();
+    } else if (!Guard.try_lock()) {
+      // someone else is deciding, so go with what's being served now.
+      return *versionOf(Info.Published.load(std::memory_order_acquire));
+    }
+
+    return decide(Info);
+  }
+
+  static void exportEntry(std::ostream& file, Entry const& E,
+                          std::optional<unsigned> SizeClass, bool &pastFirst) {
+    if (pastFirst)
+      JSON::comma(file);
+
+    pastFirst |= true;
+
+    JSON::beginObject(file);
+
+    if (SizeClass)
+      JSON::output(file, "size_class", SizeClass.value());
+    JSON::output(file, "requests", E.Requests.load());
+    JSON::output(file, "experiments", E.FullExperiments.load());
+    JSON::output(file, "fast_experiments", E.FastExperiments.load());
+    JSON::output(file, "best_swaps", E.BestSwaps.load());
+    JSON::output(file, "evictions", E.Evictions.load());
+    JSON::output(file, "abandoned", E.Abandoned.load());
+    JSON::output(file, "trial_time", E.TrialTime.load());
+    JSON::output(file, "best_time", E.BestTime.load());
+    JSON::output(file, "deploy_thresh", E.DeploymentThresh.load());
+
+    E.Opt->dumpStats(file);
+
+    JSON::endObject(file);
+  }
+
+  public:
+  // the critical values of betterThan are built here, rather than by the
+  // first comparison, which happens while holding the lock of an entry.
+  ATDriver() {
+    tuner::prepareCriticalValues();
+  }
+
+  // Tuning starts from the best configurations recorded in the given file
+  // by a prior run, and this run's best configurations are written back to
+  // it when the driver is destroyed.
+  ATDriver(std::string TuningDBPath)
+    : DB_(std::make_shared<tuner::TuningDB>(std::move(TuningDBPath))) {
+    tuner::prepareCriticalValues();
+  }
+
+  ~ATDriver() {
+    if (DB_)
+      saveTuning();
+  }
+
+  // writes the best configurations seen so far to the tuning database.
+  void saveTuning() {
+    if (!DB_)
+      return;
+
+    {
+      std::shared_lock<std::shared_mutex> Reader(StateLock_);
+      for (auto const &State : DriverState_)
+        forEachClass(*State.second, [&](Entry &E) { E.Opt->saveTuning(*DB_); });
+    }
+
+    DB_->save();
+  }
+
+  // bounds the number of function + context pairs being tuned, where 0
+  // means unbounded. Once the limit is reached, a pair that was not used
+  // recently, nor bound, is evicted to make room for a new one.
+  void setMaxEntries(size_t Max) {
+    std::unique_lock<std::shared_mutex> Writer(StateLock_);
+    MaxEntries_.store(Max);
+  }
+
+  // bounds the share of each function's running time that is spent in
+  // experimental versions, e.g., 0.02 for 2%. A negative value means
+  // unbounded, which is the default.
+  void setTrialBudget(double Fraction) {
+    Budget_->setTrialFraction(Fraction);
+  }
+
+  // bounds the CPU time spent on compilation, across all functions, to the
+  // given seconds per minute. A negative value means unbounded, which is
+  // the default.
+  void setCompileBudget(double SecsPerMin) {
+    Budget_->setCompileSecsPerMin(SecsPerMin);
+  }
+
+  // the total CPU time spent on compilation so far, in ns.
+  uint64_t compileTime() const {
+    return Budget_->compileTime();
+  }
+
+  // the number of function + context pairs evicted so far.
+  uint64_t evictions() const {
+    return EntryEvictions_.load();
+  }
+
+  void exportStats() {
+    exportStats(std::cout);
+  }
+
+  // std::filesystem not available in GCC 7
+  void exportStats(std::string out) {
+    std::ofstream file;
+    // if the file already exists, we try to find a new file name for the data.
+    // TODO
+    file.open(out, std::ios::out | std::ios::trunc);
+
+    exportStats(file);
+    file.close();
+  }
+
+  void exportStats(std::ostream& file) {
+    // formatting preferences
+    file << std::setprecision(10);
+
+    std::shared_lock<std::shared_mutex> Reader(StateLock_);
+
+    JSON::beginArray(file);
+    bool pastFirst = false;
+    for (auto const &State : DriverState_) {
+      Entry &Info = *State.second;
+
+      // an entry that only dispatches to its size classes is never served.
+      if (!Info.DispatchOn || Info.Published.load())
+        exportEntry(file, Info, std::nullopt, pastFirst);
+
+      // each size class is listed as if it were its own entry.
+      for (unsigned Class = 0; Class < NumSizeClasses; Class++)
+        if (Entry *E = Info.Classes[Class].load())
+          exportEntry(file, *E, Class, pastFirst);
+    }
+    JSON::endArray(file);
+  }
+
+  template<class T, class ... Args>
+  auto const& EASY_JIT_COMPILER_INTERFACE reoptimize(T &&Fun, Args&& ... args) {
+    using wrapper_ty = decltype(easy::jit(std::forward<T>(Fun), std::forward<Args>(args)...));
+
+    // the version returned stays valid until this thread's next reoptimize.
+    tuner::Epochs::pin();
+
+    Entry &Info = getEntry<T, Args...>(/*Bind=*/false, Fun, std::forward<Args>(args)...);
+
+    return reinterpret_cast<wrapper_ty&>(serve(Info));
 
   } // end of reoptimize
 
+  // Equivalent to reoptimize, except that a persistent handle is returned
+  // instead of a particular version. Prefer this when the same function and
+  // arguments are reoptimized repeatedly, such as in a hot loop.
+  template<class T, class ... Args>
+  auto EASY_JIT_COMPILER_INTERFACE bind(T &&Fun, Args&& ... args) {
+    using wrapper_ty = decltype(easy::jit(std::forward<T>(Fun), std::forward<Args>(args)...));
+
+    Entry &Info = getEntry<T, Args...>(/*Bind=*/true, Fun, std::forward<Args>(args)...);
+
+    return TunedFunction<wrapper_ty>(Info);
+  }
+
+  private:
+  template<class T, class ... Args>
+  Entry& getEntry(bool Bind, T &Fun, Args&& ... args) {
+    void* FunPtr = reinterpret_cast<void*>(easy::meta::get_as_pointer(Fun));
+
+    Key K(FunPtr, easy::get_context_for<T, Args...>(std::forward<Args>(args)...));
+
+    return lookup(K, [&] {
+      // only a new entry needs a context the optimizers can share. The
+      // optimizer's initialization is deferred to its first compile, so
+      // that we do not do that work while holding the state lock.
+      auto Cxt = std::make_shared<easy::Context>(K.second);
+      auto MakeOpt = [FunPtr, Cxt, DB = DB_, Budget = Budget_] {
+        return std::make_unique<tuner::Optimizer>(FunPtr, Cxt, /*LazyInit=*/true, DB, Budget);
+      };
+
+      auto E = std::make_unique<Entry>(MakeOpt(), Budget_);
+      if (unsigned Pos = Cxt->getDispatchOn()) {
+        E->DispatchOn = Pos;
+        E->MakeClassOpt = MakeOpt;
+      }
+      return E;
+    }, Bind);
+  }
+
 }; // end class
 
+template<class WrapperTy>
+WrapperTy const& TunedFunction<WrapperTy>::get() const {
+  tuner::Epochs::pin();
+  return reinterpret_cast<WrapperTy const&>(ATDriver::serve(*Info_));
+}
+
+template<class WrapperTy>
+template<class ... Args>
+WrapperTy const& TunedFunction<WrapperTy>::select(Args const& ... args) const {
+  unsigned Pos = Info_->DispatchOn;
+  if (Pos == 0)
+    return get();
+
+  tuner::Epochs::pin();
+
+  auto &Class = ATDriver::classEntry(*Info_, sizeClassOf(Pos, args...));
+  return reinterpret_cast<WrapperTy const&>(ATDriver::serve(Class));
+}
+
+template<class WrapperTy>
+template<class ... Args>
+decltype(auto) TunedFunction<WrapperTy>::operator()(Args&& ... args) const {
+  OptimizationInfo *Info = Info_;
+  if (unsigned Pos = Info->DispatchOn)
+    Info = Info->Classes[sizeClassOf(Pos, args...)].load(std::memory_order_acquire);
+
+  // a final version is never retired, so the thread need not be pinned,
+  // and its measurements would go unused, so it is called directly.
+  if (Info) {
+    uintptr_t Published = Info->Published.load(std::memory_order_acquire);
+    if (Published & FinalBit) {
+      auto *Version = reinterpret_cast<WrapperTy const*>(versionOf(Published));
+      return Version->getFunctionPointer()(std::forward<Args>(args)...);
+    }
+  }
+
+  return select(args...)(std::forward<Args>(args)...);
+}
+
 } // end namespace
@@ -2,12 +2,14 @@
 
 #include <list>
 #include <mutex>
+#include <condition_variable>
 #include <fstream>
 
 #include <dispatch/dispatch.h>
 
 #include <easy/runtime/Context.h>
 #include <easy/runtime/BitcodeTracker.h>
+#include <easy/exceptions.h>
 
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/Target/TargetMachine.h>
@@ -18,9 +20,14 @@
 #include <tuner/KnobSet.h>
 #include <tuner/Feedback.h>
 #include <tuner/CodegenOptions.h>
+#include <tuner/TuningDB.h>
+#include <tuner/ExperimentBudget.h>
 
 namespace tuner {
 
+  DefineEasyException(CompileJobTimeout, "A compile job took too long for: ");
+  DefineEasyException(CodeOnlyUnsupported, "code_only cannot free the code of versions in an ORC session, for: ");
+
   using CompileResult =
    std::pair<std::unique_ptr<easy::Function>, std::shared_ptr<tuner::Feedback>>;
 
@@ -34,16 +41,26 @@ namespace tuner {
     CompileResult Result;
   };
 
-  struct OptimizeResult {
+  // a snapshot of the knobs that control the pass pipeline and codegen,
+  // taken right after a configuration has been applied.
+  struct PipelineOptions {
+    unsigned OptLevel;
+    unsigned OptSize;
+    int InlineThreshold;
+    llvm::CodeGenOpt::Level CGLevel;
+    bool FastISel;
+    bool IPRA;
+  };
+
+  // a module that has been specialized to one configuration. It is first
+  // optimized, and then code generated.
+  struct CompileJob {
   public:
     std::unique_ptr<llvm::Module> M;
     std::unique_ptr<llvm::LLVMContext> LLVMCxt;
     std::shared_ptr<tuner::Feedback> FB;
     Optimizer* Opt;
-    bool End;
-    llvm::CodeGenOpt::Level CGLevel;
-    bool FastISel;
-    bool IPRA;
+    PipelineOptions Opts;
   };
 
 namespace opt_status {
@@ -71,8 +88,6 @@ private:
   // metadata about the function being compiled
   std::tuple<const char*, easy::GlobalMapping*> GMap_;
 
-  // members related to the pass manager that we need to keep alive.
-  std::unique_ptr<llvm::TargetMachine> TM_;
   bool InitializedSelf_;
 
   //////////
@@ -89,12 +104,21 @@ private:
   // members related to concurrent JIT compilation
 
   // the initial job queue for recompile requests.
-  // it is a serial queue that optimizes the IR.
+  // it is a serial queue that applies a batch of configurations to the IR,
+  // whose pass pipelines are then run concurrently on pipelineQ_.
   dispatch_queue_t optimizeQ_;
+  dispatch_queue_t pipelineQ_;
 
-  // a serial job queue for IR -> asm compilation
+  // a concurrent job queue for IR -> asm compilation, since each
+  // optimized module is independent of the others.
   dispatch_queue_t codegenQ_;
-  std::atomic<bool> recompileActive_ = false;
+
+  // all optimize and codegen jobs are members of this group.
+  dispatch_group_t compileJobs_;
+
+  // the number of optimize jobs whose result has not yet been added
+  // to the ready list.
+  std::atomic<unsigned> pendingCompiles_ = 0;
 
   // serial list-access queues. The dispatch
   // queue is basically a semaphore.
@@ -102,19 +126,58 @@ private:
   std::list<CompileResult> recompileDone_;
   std::atomic<bool> doneQueueEmpty_ = true;
 
+  // signalled whenever a result is added to the list. doneQueueEmpty_ is
+  // only set to false while holding the mutex, so waiters never miss it.
+  std::mutex resultAddedLock_;
+  std::condition_variable resultAdded_;
+
+  // once set, no more compile-ahead jobs will be started.
+  std::atomic<bool> stopCompilingAhead_ = false;
+
 
 
   /////////////
 
-  std::unique_ptr<llvm::legacy::PassManager> genPassManager();
+  std::unique_ptr<llvm::legacy::PassManager> genSpecializer();
+  std::unique_ptr<llvm::legacy::PassManager> genPassManager(PipelineOptions const&, llvm::TargetMachine&);
+  PipelineOptions snapshotOptions();
   void findContextKnobs(KnobSet &);
 
   // members related to automatic tuning
   Tuner *Tuner_;
   bool isNoopTuner_ = false;
 
+  // members related to persisting tuning results
+  std::shared_ptr<TuningDB> DB_;
+  std::unordered_map<KnobID, std::string> ParamNames_;
+
+  // distinguishes this optimizer's records from those of others tuning
+  // the same function + context, e.g., for another size class.
+  std::string Variant_;
+
+  // a config to start from when the database has none.
+  std::optional<TuningRecord> Seed_;
+
+  // charged for the time spent compiling, if any.
+  std::shared_ptr<ExperimentBudget> Budget_;
+
+  std::string tuningKey() const;
+
+  // a name for the knob that is stable across processes.
+  template <typename KnobTy>
+  std::string knobName(KnobTy const& K) const {
+    auto Found = ParamNames_.find(K.getID());
+    if (Found != ParamNames_.end())
+      return Found->second;
+    return K.getName();
+  }
+
+  KnobConfig seedFromRecord(TuningRecord const&, KnobSet const&) const;
+
 public:
-  Optimizer(void* Addr, std::shared_ptr<easy::Context> Cxt, bool LazyInit = false);
+  Optimizer(void* Addr, std::shared_ptr<easy::Context> Cxt, bool LazyInit = false,
+            std::shared_ptr<TuningDB> DB = nullptr,
+            std::shared_ptr<ExperimentBudget> Budget = nullptr);
   ~Optimizer();
 
   // the "lazy" initializer that must be called manually if LazyInit == true
@@ -133,7 +196,9 @@ public:
   //// these callbacks are a bit ugly.
   void addToList_callback(AddCompileResult*);
   void optimize_callback();
-  void codegen_callback(OptimizeResult*);
+  void pipelinesDone_callback();
+  void pipeline_callback(CompileJob*);
+  void codegen_callback(CompileJob*);
   void obtain_callback(RecompileRequest*);
 
   CompileResult recompile();
@@ -142,6 +207,16 @@ public:
 
   void dumpStats(std::ostream &) const;
 
+  // records the best config seen so far in the given database.
+  void saveTuning(TuningDB &);
+
+  // the best config seen so far, if it has been measured.
+  std::optional<TuningRecord> bestRecord();
+
+  // these must be called before the optimizer is initialized.
+  void setVariant(std::string Variant) { Variant_ = std::move(Variant); }
+  void seedWith(TuningRecord Rec) { Seed_ = std::move(Rec); }
+
 }; // end class
 
 } // end namespace
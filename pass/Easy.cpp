@@ -59,7 +59,7 @@ namespace easy {
       collectLocalGlobals(M, LocalVariables);
       nameGlobals(LocalVariables, "unnamed_local_global");
 
-      auto Bitcode = embedBitcode(M, ObjectsToJIT);
+      GlobalVariable* Bitcode = embedBitcode(M, ObjectsToJIT);
       GlobalVariable* GlobalMapping = getGlobalMapping(M, LocalVariables);
 
       Function* RegisterBitcodeFun = declareRegisterBitcode(M, GlobalMapping);
@@ -286,25 +286,22 @@ namespace easy {
                                 Init, "global_mapping");
     }
 
-    static SmallVector<GlobalVariable*, 8>
-    embedBitcode(Module &M, SmallVectorImpl<GlobalObject*> &Objs) {
-      SmallVector<GlobalVariable*, 8> Bitcode(Objs.size());
-      for(size_t i = 0, n = Objs.size(); i != n; ++i)
-        Bitcode[i] = embedBitcode(M, *Objs[i]);
-      return Bitcode;
-    }
-
-    static GlobalVariable* embedBitcode(Module &M, GlobalObject& GO) {
+    // embeds a single module holding all of the objects to JIT, along with
+    // everything they reference. The runtime lazily extracts the part of it
+    // needed by a particular object.
+    static GlobalVariable* embedBitcode(Module &M, SmallVectorImpl<GlobalObject*> &Objs) {
       std::unique_ptr<Module> Embed = CloneModule(PASS_MODULE_ARG(M));
 
-      GlobalValue *FEmbed = Embed->getNamedValue(GO.getName());
-      assert(FEmbed && "global value with that name exists");
-      cleanModule(*FEmbed, *Embed);
+      SmallVector<GlobalValue*, 8> Entries;
+      for(GlobalObject *GO : Objs) {
+        GlobalValue *GVEmbed = Embed->getNamedValue(GO->getName());
+        assert(GVEmbed && "global value with that name exists");
+        Entries.push_back(GVEmbed);
+      }
 
-      Twine ModuleName = GO.getName() + "_bitcode";
-      Embed->setModuleIdentifier(ModuleName.str());
+      cleanModule(Entries, *Embed);
 
-      return writeModuleToGlobal(M, *Embed, FEmbed->getName() + "_bitcode");
+      return writeModuleToGlobal(M, *Embed, "easy_jit_bitcode");
     }
 
     static std::string moduleToString(Module &M) {
@@ -323,20 +320,23 @@ namespace easy {
                                 BitcodeInit, Name);
     }
 
-    static void cleanModule(GlobalValue &Entry, Module &M) {
+    static void cleanModule(SmallVectorImpl<GlobalValue*> &Entries, Module &M) {
 
       llvm::StripDebugInfo(M);
 
-      bool ForFunction = isa<Function>(Entry);
-
-      auto Referenced = getReferencedFromEntry(Entry);
-      Referenced.push_back(&Entry);
+      std::vector<GlobalValue*> Referenced;
+      for(GlobalValue *Entry : Entries) {
+        auto FromEntry = getReferencedFromEntry(*Entry);
+        Referenced.insert(Referenced.end(), FromEntry.begin(), FromEntry.end());
+        Referenced.push_back(Entry);
 
-      if(ForFunction) {
-        Entry.setLinkage(GlobalValue::ExternalLinkage);
+        if(isa<Function>(Entry)) {
+          Entry->setLinkage(GlobalValue::ExternalLinkage);
+        }
       }
 
-      // clean & canonicalize the cloned module
+      // clean & canonicalize the cloned module.
+      // NOTE: the linkages are fixed up by the runtime for each entry.
       legacy::PassManager Passes;
       Passes.add(createGVExtractionPass(Referenced));
       Passes.add(createGlobalDCEPass());
@@ -344,10 +344,6 @@ namespace easy {
       Passes.add(createStripDeadPrototypesPass());
       Passes.add(tuner::createLoopNamerPass());
       Passes.run(M);
-
-      if(ForFunction) {
-        fixLinkages(Entry, M);
-      }
     }
 
     static std::vector<GlobalValue*> getReferencedFromEntry(GlobalValue &Entry) {
@@ -383,31 +379,6 @@ namespace easy {
       return Funs;
     }
 
-    static void fixLinkages(GlobalValue &Entry, Module &M) {
-      for(GlobalValue &GV : M.global_values()) {
-        if(GV.getName().startswith("llvm."))
-          continue;
-        if(auto* GVar = dyn_cast<GlobalVariable>(&GV)) {
-          // gv becomes a declaration
-          GVar->setInitializer(nullptr);
-          GVar->setVisibility(GlobalValue::DefaultVisibility);
-          GVar->setLinkage(GlobalValue::ExternalLinkage);
-        } else if(auto* F = dyn_cast<Function>(&GV)) {
-          // f becomes private
-          F->removeFnAttr(Attribute::NoInline);
-          if(F == &Entry)
-            continue;
-
-          if(!F->isDeclaration() &&
-             (F->getVisibility() != GlobalValue::DefaultVisibility ||
-              F->getLinkage() != GlobalValue::PrivateLinkage)) {
-            F->setVisibility(GlobalValue::DefaultVisibility);
-            F->setLinkage(GlobalValue::PrivateLinkage);
-          }
-        } else assert(false && "TODO: handle aliases, etc.");
-      }
-    }
-
     Function* declareRegisterBitcode(Module &M, GlobalVariable *GlobalMapping) {
       StringRef Name = "easy_register";
       if(Function* F = M.getFunction(Name))
@@ -430,7 +401,7 @@ namespace easy {
 
     static void
     registerBitcode(Module &M, SmallVectorImpl<GlobalObject*> &Objs,
-                    SmallVectorImpl<GlobalVariable*> &Bitcodes,
+                    GlobalVariable* Bitcodes,
                     Value* GlobalMapping,
                     Function* RegisterBitcodeFun) {
       // Create static initializer with low priority to register everything
@@ -442,15 +413,18 @@ namespace easy {
       Function *Ctor = getCtor(M);
       IRBuilder<> B(Ctor->getEntryBlock().getTerminator());
 
+      // every object shares the same bitcode
+      ArrayType* ArrTy = cast<ArrayType>(Bitcodes->getInitializer()->getType());
+      size_t Size = ArrTy->getNumElements()-1; /*-1 for the 0 terminator*/
+
+      Value* Bitcode = B.CreatePointerCast(Bitcodes, BitcodePtr);
+      Value* BitcodeSize = ConstantInt::get(SizeTy, Size, false);
+
       for(size_t i = 0, n = Objs.size(); i != n; ++i) {
         GlobalVariable* Name = getStringGlobal(M, Objs[i]->getName());
-        ArrayType* ArrTy = cast<ArrayType>(Bitcodes[i]->getInitializer()->getType());
-        size_t Size = ArrTy->getNumElements()-1; /*-1 for the 0 terminator*/
 
         Value* Fun = B.CreatePointerCast(Objs[i], FPtr);
         Value* NameCast = B.CreatePointerCast(Name, StrPtr);
-        Value* Bitcode = B.CreatePointerCast(Bitcodes[i], BitcodePtr);
-        Value* BitcodeSize = ConstantInt::get(SizeTy, Size, false);
 
         // fun, name, gm, bitcode, bitcode size
         B.CreateCall(RegisterBitcodeFun,
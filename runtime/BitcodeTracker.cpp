@@ -3,6 +3,14 @@
 #include <llvm/Bitcode/BitcodeReader.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/IR/DiagnosticHandler.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/ADT/SmallPtrSet.h>
+
+#include <atomic>
+#include <thread>
 
 #include <easy/exceptions.h>
 
@@ -14,6 +22,114 @@ namespace easy {
   DefineEasyException(BitcodeParseError, "Cannot parse bitcode for: ");
 }
 
+// collects the functions the entry depends on, materializing
+// each of their bodies along the way.
+static std::vector<GlobalValue*> materializeReferenced(GlobalValue &Entry, const char* Name) {
+  std::vector<GlobalValue*> Funs;
+
+  SmallPtrSet<User*, 32> Visited;
+  SmallVector<User*, 8> ToVisit;
+  ToVisit.push_back(&Entry);
+
+  while(!ToVisit.empty()) {
+    User* U = ToVisit.pop_back_val();
+    if(!Visited.insert(U).second)
+      continue;
+    if(Function* UF = dyn_cast<Function>(U)) {
+      if(auto Err = UF->materialize()) {
+        llvm::consumeError(std::move(Err));
+        throw easy::BitcodeParseError(Name);
+      }
+
+      Funs.push_back(UF);
+
+      for(Instruction &I : instructions(UF))
+        for(Value* Op : I.operands())
+          if(User* OpU = dyn_cast<User>(Op))
+            ToVisit.push_back(OpU);
+    }
+    else if(GlobalVariable* GV = dyn_cast<GlobalVariable>(U)) {
+      if(GV->hasInitializer()) {
+        ToVisit.push_back(GV->getInitializer());
+      }
+    }
+
+    for(Value* Op : U->operands())
+      if(User* OpU = dyn_cast<User>(Op))
+        ToVisit.push_back(OpU);
+  }
+
+  return Funs;
+}
+
+static void fixLinkages(GlobalValue &Entry, Module &M) {
+  for(GlobalValue &GV : M.global_values()) {
+    if(GV.getName().startswith("llvm."))
+      continue;
+    if(auto* GVar = dyn_cast<GlobalVariable>(&GV)) {
+      // gv becomes a declaration
+      GVar->setInitializer(nullptr);
+      GVar->setVisibility(GlobalValue::DefaultVisibility);
+      GVar->setLinkage(GlobalValue::ExternalLinkage);
+    } else if(auto* F = dyn_cast<Function>(&GV)) {
+      // f becomes private
+      F->removeFnAttr(Attribute::NoInline);
+      if(F == &Entry)
+        continue;
+      if(!F->isDeclaration() &&
+         (F->getVisibility() != GlobalValue::DefaultVisibility ||
+          F->getLinkage() != GlobalValue::PrivateLinkage)) {
+        F->setVisibility(GlobalValue::DefaultVisibility);
+        F->setLinkage(GlobalValue::PrivateLinkage);
+      }
+    } else assert(false && "TODO: handle aliases, etc.");
+  }
+}
+
+// The bitcode embedded by the pass is shared by all objects registered from
+// the same translation unit. This extracts only what the named entry needs,
+// without ever reading the bodies of the other functions.
+static std::unique_ptr<Module> extractEntry(std::unique_ptr<Module> M, const char* Name) {
+  GlobalValue* Entry = M->getNamedValue(Name);
+  if(!Entry)
+    throw easy::BitcodeParseError(Name);
+
+  bool ForFunction = isa<Function>(Entry);
+
+  std::vector<GlobalValue*> Referenced = materializeReferenced(*Entry, Name);
+  Referenced.push_back(Entry);
+
+  // drops the bodies of everything else, which are never materialized.
+  legacy::PassManager Extract;
+  Extract.add(createGVExtractionPass(Referenced));
+  Extract.run(*M);
+
+  if(auto Err = M->materializeAll()) {
+    llvm::consumeError(std::move(Err));
+    throw easy::BitcodeParseError(Name);
+  }
+
+  legacy::PassManager Clean;
+  Clean.add(createGlobalDCEPass());
+  Clean.add(createStripDeadPrototypesPass());
+  Clean.run(*M);
+
+  if(ForFunction) {
+    fixLinkages(*Entry, *M);
+  }
+
+  M->setModuleIdentifier(std::string(Name) + "_bitcode");
+  return M;
+}
+
+namespace {
+  std::atomic<uint64_t> Parses{0};
+}
+
+uint64_t BitcodeTracker::parses() {
+  return Parses.load();
+}
+
 BitcodeTracker& BitcodeTracker::GetTracker() {
   static BitcodeTracker TheTracker;
   return TheTracker;
@@ -49,49 +165,141 @@ const char* BitcodeTracker::getName(void* FPtr) {
   return InfoPtr->second.Name;
 }
 
-std::unique_ptr<llvm::Module> BitcodeTracker::getModuleWithContext(void* FPtr, llvm::LLVMContext &C) {
+std::unique_ptr<llvm::Module> BitcodeTracker::parseModule(void* FPtr, llvm::LLVMContext &C) {
   auto InfoPtr = Functions.find(FPtr);
   if(InfoPtr == Functions.end()) {
     throw easy::BitcodeNotRegistered();
   }
 
   auto &Info = InfoPtr->second;
+  Parses++;
 
-  llvm::StringRef BytecodeStr(Info.Bitcode, Info.BitcodeLen);
-  std::unique_ptr<llvm::MemoryBuffer> Buf(llvm::MemoryBuffer::getMemBuffer(BytecodeStr));
-  auto ModuleOrErr =
-      llvm::parseBitcodeFile(Buf->getMemBufferRef(), C);
+  // the embedded bitcode lives as long as the program,
+  // so the module can be materialized from it lazily.
+  llvm::MemoryBufferRef Buf(llvm::StringRef(Info.Bitcode, Info.BitcodeLen), Info.Name);
+  auto ModuleOrErr = llvm::getLazyBitcodeModule(Buf, C);
 
-  if (ModuleOrErr.takeError()) {
+  if (auto Err = ModuleOrErr.takeError()) {
+    llvm::consumeError(std::move(Err));
     throw easy::BitcodeParseError(Info.Name);
   }
 
-  return std::move(ModuleOrErr.get());
+  return extractEntry(std::move(ModuleOrErr.get()), Info.Name);
 }
 
-#ifdef NDEBUG
-class DiagnosticSilencer : public llvm::DiagnosticHandler {
+// the diagnostic handler of a pooled context, which owns its master modules.
+// The masters stay in the context for as long as it is pooled.
+// While the tag is alive, it is registered in the tracker's Tags_, so the
+// tag of a context that is destroyed without being released is forgotten
+// along with it.
+class BitcodeTracker::PoolTag : public llvm::DiagnosticHandler {
+  BitcodeTracker &BT;
+
 public:
-  DiagnosticSilencer() {}
+  MasterModules Masters;
+  unsigned Leases = 0;
+
+  PoolTag(BitcodeTracker &T) : BT(T) {
+    std::lock_guard<std::mutex> Guard(BT.PoolLock_);
+    BT.Tags_.emplace(this, this);
+  }
+
+  // the context frees the master modules still living in it on its own,
+  // before destroying its diagnostic handler.
+  ~PoolTag() override {
+    std::lock_guard<std::mutex> Guard(BT.PoolLock_);
+    BT.Tags_.erase(this);
+  }
+
+#ifdef NDEBUG
+  // silence the output as much as possible!
   bool handleDiagnostics(const DiagnosticInfo &DI) override { return true; }
   bool isAnalysisRemarkEnabled(StringRef PassName) const override { return false; }
   bool isMissedOptRemarkEnabled(StringRef PassName) const override { return false; }
   bool isPassedOptRemarkEnabled(StringRef PassName) const override { return false; }
-}; // end class
 #endif
+}; // end class
 
-BitcodeTracker::ModuleContextPair BitcodeTracker::getModule(void* FPtr) {
+BitcodeTracker::PoolTag* BitcodeTracker::getTag(llvm::LLVMContext const &C) {
+  std::lock_guard<std::mutex> Guard(PoolLock_);
+  auto Found = Tags_.find(C.getDiagHandlerPtr());
+  if (Found == Tags_.end())
+    return nullptr;
+  return Found->second;
+}
+
+std::unique_ptr<llvm::Module> BitcodeTracker::getModuleWithContext(void* FPtr, llvm::LLVMContext &C) {
+  PoolTag* Tag = getTag(C);
+
+  if (!Tag)
+    return parseModule(FPtr, C);
 
-  std::unique_ptr<llvm::LLVMContext> Context(new llvm::LLVMContext());
+  // we hold the lease on this context, so nobody else
+  // is touching its master modules.
+  llvm::Module* &Master = Tag->Masters[FPtr];
+  if (!Master)
+    Master = parseModule(FPtr, C).release();
+
+  return llvm::CloneModule(*Master);
+}
+
+std::unique_ptr<llvm::LLVMContext> BitcodeTracker::leaseContext() {
+  std::unique_ptr<llvm::LLVMContext> Context;
+  {
+    std::lock_guard<std::mutex> Guard(PoolLock_);
+    if (!IdleContexts_.empty()) {
+      Context = std::move(IdleContexts_.back());
+      IdleContexts_.pop_back();
+    }
+  }
+
+  if (!Context) {
+    Context.reset(new llvm::LLVMContext());
+    Context->setDiagnosticHandler(std::make_unique<PoolTag>(*this));
 
 #ifdef NDEBUG
-  // silence the output as much as possible!
-  Context->setDiagnosticHandler(std::make_unique<DiagnosticSilencer>());
-  Context->setDiagnosticsHotnessThreshold(~0);
+    Context->setDiagnosticsHotnessThreshold(~0);
 #else
-  // preserve names in the IR for debugging.
-  Context->setDiscardValueNames(false);
+    // preserve names in the IR for debugging.
+    Context->setDiscardValueNames(false);
 #endif
+  }
+
+  // only we hold the context now.
+  getTag(*Context)->Leases += 1;
+  return Context;
+}
+
+bool BitcodeTracker::isPooled(llvm::LLVMContext const &C) {
+  return getTag(C) != nullptr;
+}
+
+void BitcodeTracker::releaseContext(std::unique_ptr<llvm::LLVMContext> C) {
+  if (!C)
+    return;
+
+  PoolTag* Tag = getTag(*C);
+  if (!Tag)
+    return; // not from the pool
+
+  // types and constants are never freed by a context, so one that keeps
+  // being reused would only grow.
+  const unsigned MaxLeases = 16;
+  if (Tag->Leases >= MaxLeases)
+    return;
+
+  // there is no point in keeping more idle contexts
+  // around than could be used at once.
+  const size_t MaxIdle = std::max(2u, 2 * std::thread::hardware_concurrency());
+
+  std::lock_guard<std::mutex> Guard(PoolLock_);
+  if (IdleContexts_.size() < MaxIdle)
+    IdleContexts_.push_back(std::move(C));
+}
+
+BitcodeTracker::ModuleContextPair BitcodeTracker::getModule(void* FPtr) {
+
+  std::unique_ptr<llvm::LLVMContext> Context = leaseContext();
 
   auto Module = getModuleWithContext(FPtr, *Context);
 
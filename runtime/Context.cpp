@@ -3,50 +3,137 @@
 using namespace easy;
 
 Context& Context::setParameterIndex(unsigned param_idx) {
-  return setArg<ForwardArgument>(param_idx);
+  beginArg(ArgumentBase::AK_Forward);
+  appendKey(param_idx);
+  return *this;
 }
 
 Context& Context::setParameterInt(int64_t val) {
-  return setArg<IntArgument>(val);
+  beginArg(ArgumentBase::AK_Int);
+  appendKey(val);
+  return *this;
 }
 
+// NOTE: floats are keyed by their bits, so 0.0 and -0.0 are different,
+// while a NaN is equal to itself.
 Context& Context::setParameterFloat(double val) {
-  return setArg<FloatArgument>(val);
+  beginArg(ArgumentBase::AK_Float);
+  appendKey(val);
+  return *this;
 }
 
 Context& Context::setParameterPointer(const void* val) {
-  return setArg<PtrArgument>(val);
+  beginArg(ArgumentBase::AK_Ptr);
+  appendKey(val);
+  return *this;
 }
 
 Context& Context::setParameterStruct(char const* ptr, size_t size) {
-  return setArg<StructArgument>(ptr, size);
+  beginArg(ArgumentBase::AK_Struct);
+  appendKey((uint64_t) size);
+  Key_.append(ptr, size);
+  return *this;
 }
 
+// two modules are equal only if they are the same function, which is
+// decided by its holder, as in easy::Function::operator==. The function
+// itself follows, to decode the argument.
 Context& Context::setParameterModule(easy::Function const &F) {
-  return setArg<ModuleArgument>(F);
+  beginArg(ArgumentBase::AK_Module);
+  appendKey(F.getHolder());
+  appendKey(&F);
+  return *this;
 }
 
 Context& Context::setTunableParam(tuned_param::IntRange K) {
-  return setArg<IntRangeArgument>(new tuned_param::IntRange(K));
+  beginArg(ArgumentBase::AK_IntRange);
+  appendKey(K.min());
+  appendKey(K.max());
+  appendKey(K.getDefault());
+  return *this;
 }
 
-bool Context::operator==(const Context& Other) const {
-  if(getOptLevel() != Other.getOptLevel())
-    return false;
+Context::Arguments Context::decodeArguments() const {
+  Arguments Args;
+  Args.reserve(NumArgs_);
+
+  char const* Pos = Key_.data();
+  auto Read = [&Pos](auto &Val) {
+    std::memcpy(&Val, Pos, sizeof(Val));
+    Pos += sizeof(Val);
+  };
+
+  for (unsigned i = 0; i != NumArgs_; ++i) {
+    auto Kind = (ArgumentBase::ArgumentKind) *Pos++;
+    switch (Kind) {
+      case ArgumentBase::AK_Forward: {
+        unsigned Idx;
+        Read(Idx);
+        Args.emplace_back(new ForwardArgument(Idx));
+      } break;
+
+      case ArgumentBase::AK_Int: {
+        int64_t Val;
+        Read(Val);
+        Args.emplace_back(new IntArgument(Val));
+      } break;
+
+      case ArgumentBase::AK_Float: {
+        double Val;
+        Read(Val);
+        Args.emplace_back(new FloatArgument(Val));
+      } break;
 
-  if(size() != Other.size())
-    return false;
+      case ArgumentBase::AK_Ptr: {
+        void const* Ptr;
+        Read(Ptr);
+        Args.emplace_back(new PtrArgument(Ptr));
+      } break;
 
-  if(getTunerKind() != Other.getTunerKind())
-    return false;
+      case ArgumentBase::AK_Struct: {
+        uint64_t Size;
+        Read(Size);
+        Args.emplace_back(new StructArgument(Pos, Size));
+        Pos += Size;
+      } break;
 
-  for(auto this_it = begin(), other_it = Other.begin();
-      this_it != end(); ++this_it, ++other_it) {
-    ArgumentBase &ThisArg = **this_it;
-    ArgumentBase &OtherArg = **other_it;
-    if(!(ThisArg == OtherArg))
-      return false;
+      case ArgumentBase::AK_Module: {
+        easy::LLVMHolder const* Holder;
+        easy::Function const* F;
+        Read(Holder);
+        Read(F);
+        Args.emplace_back(new ModuleArgument(*F));
+      } break;
+
+      // the knob is created along with the arguments, so each context
+      // that is compiled from has its own knob for the tuner to set.
+      case ArgumentBase::AK_IntRange: {
+        int Min, Max, Default;
+        Read(Min);
+        Read(Max);
+        Read(Default);
+        Args.emplace_back(new IntRangeArgument(
+            std::make_shared<tuned_param::IntRange>(Min, Max, Default)));
+      } break;
+    }
   }
 
-  return true;
+  return Args;
+}
+
+bool Context::operator==(const Context& Other) const {
+  return OptLevel_ == Other.OptLevel_ &&
+         OptSize_ == Other.OptSize_ &&
+         TunerKind_ == Other.TunerKind_ &&
+         Key_ == Other.Key_ &&
+         FeedbackKind_ == Other.FeedbackKind_ &&
+         WaitForCompile_ == Other.WaitForCompile_ &&
+         OptimizeWidth_ == Other.OptimizeWidth_ &&
+         CompileTimeoutMs_ == Other.CompileTimeoutMs_ &&
+         CodeOnly_ == Other.CodeOnly_ &&
+         RetainedVersions_ == Other.RetainedVersions_ &&
+         DispatchOn_ == Other.DispatchOn_ &&
+         ObjectCacheDir_ == Other.ObjectCacheDir_ &&
+         DebugFile_ == Other.DebugFile_ &&
+         DebugBeforeFile_ == Other.DebugBeforeFile_;
 }
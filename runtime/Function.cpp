@@ -3,6 +3,7 @@
 #include <easy/runtime/Function.h>
 #include <easy/runtime/RuntimePasses.h>
 #include <easy/runtime/LLVMHolderImpl.h>
+#include <easy/runtime/ObjectCache.h>
 #include <easy/runtime/Utils.h>
 #include <easy/exceptions.h>
 
@@ -20,6 +21,15 @@
 #include <llvm/Support/FileSystem.h>
 #include <llvm/IR/LegacyPassManager.h>
 
+#ifdef ORC_JIT
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+
+#include <atomic>
+#endif
+
 #include <loguru.hpp>
 
 
@@ -34,6 +44,97 @@ Function::Function(void* Addr, std::unique_ptr<LLVMHolder> H)
   : Address(Addr), Holder(std::move(H)) {
 }
 
+#ifdef ORC_JIT
+
+namespace {
+  // All versions share one ORC session. Symbols from the process are
+  // resolved by the main JITDylib, which caches them for everyone, and
+  // each version is linked into a JITDylib of its own so that the many
+  // versions of a function do not clash.
+  //
+  // NOTE: the ORC API of LLVM 8 cannot remove a JITDylib, so the code and
+  // symbol table of a version stay in memory until the process exits, even
+  // once the version itself is freed. The ATDriver frees retired, evicted
+  // and abandoned versions, which only releases their code with MCJIT.
+  // That is why MCJIT stays the default until versions can be removed.
+  class OrcSession {
+    llvm::orc::JITTargetMachineBuilder JTMB_;
+    std::unique_ptr<llvm::orc::LLJIT> JIT_;
+    std::atomic<unsigned> NextDylib_ = 0;
+
+    template<class T>
+    static T check(llvm::Expected<T> Val, const char* Name) {
+      if(!Val) {
+        llvm::consumeError(Val.takeError());
+        throw easy::ExecutionEngineCreateError(Name);
+      }
+      return std::move(*Val);
+    }
+
+    static void check(llvm::Error Err, const char* Name) {
+      if(Err) {
+        llvm::consumeError(std::move(Err));
+        throw easy::ExecutionEngineCreateError(Name);
+      }
+    }
+
+    OrcSession()
+      : JTMB_(check(llvm::orc::JITTargetMachineBuilder::detectHost(), "the ORC session")) {
+      JTMB_.setCPU(llvm::sys::getHostCPUName().str());
+
+      auto DL = check(JTMB_.getDefaultDataLayoutForTarget(), "the ORC session");
+      JIT_ = check(llvm::orc::LLJIT::Create(JTMB_, DL), "the ORC session");
+
+      JIT_->getMainJITDylib().setGenerator(
+        check(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(DL),
+              "the ORC session"));
+    }
+
+    public:
+
+    static OrcSession& get() {
+      static OrcSession Session;
+      return Session;
+    }
+
+    void* compile(const char* Name, GlobalMapping* Globals, llvm::Module &M,
+                  llvm::CodeGenOpt::Level CGLevel, bool UseFastISel, bool UseIPRA,
+                  llvm::ObjectCache* Cache) {
+      // codegen happens here rather than in the session's compile layer,
+      // so that the module stays with the version that was compiled from it.
+      llvm::orc::JITTargetMachineBuilder JTMB = JTMB_;
+      JTMB.setCodeGenOptLevel(CGLevel);
+      JTMB.getOptions().EnableFastISel = UseFastISel;
+      JTMB.getOptions().EnableIPRA = UseIPRA;
+
+      auto TM = check(JTMB.createTargetMachine(), Name);
+      auto Obj = llvm::orc::SimpleCompiler(*TM, Cache)(M);
+
+      auto &ES = JIT_->getExecutionSession();
+      auto &JD = ES.createJITDylib("atjit.version." + std::to_string(NextDylib_++),
+                                   /*AddToMainDylibSearchOrder=*/false);
+      JD.addToSearchOrder(JIT_->getMainJITDylib());
+
+      if(Globals) {
+        llvm::orc::MangleAndInterner Mangle(ES, JIT_->getDataLayout());
+        llvm::orc::SymbolMap Symbols;
+        for(GlobalMapping *GM = Globals; GM->Name; ++GM)
+          Symbols[Mangle(GM->Name)] =
+            llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(GM->Address),
+                                     llvm::JITSymbolFlags::Exported);
+        check(JD.define(llvm::orc::absoluteSymbols(std::move(Symbols))), Name);
+      }
+
+      check(JIT_->addObjectFile(JD, std::move(Obj)), Name);
+
+      auto Sym = check(JIT_->lookup(JD, Name), Name);
+      return (void*)Sym.getAddress();
+    }
+  };
+}
+
+#else
+
 static std::unique_ptr<llvm::ExecutionEngine> GetEngine(std::unique_ptr<llvm::Module> M, const char *Name, llvm::CodeGenOpt::Level CGLevel, bool UseFastISel, bool UseIPRA) {
   llvm::EngineBuilder ebuilder(std::move(M));
   std::string eeError;
@@ -62,6 +163,8 @@ static void MapGlobals(llvm::ExecutionEngine& EE, GlobalMapping* Globals) {
   }
 }
 
+#endif // ORC_JIT
+
 void Function::WriteOptimizedToFile(llvm::Module const &M, std::string const& File, bool Append) {
   if(File.empty())
     return;
@@ -85,8 +188,21 @@ Function::CompileAndWrap(const char*Name, GlobalMapping* Globals,
                std::unique_ptr<llvm::Module> M,
                llvm::CodeGenOpt::Level CGLevel,
                bool UseFastISel,
-               bool UseIPRA) {
+               bool UseIPRA,
+               std::string const& ObjectCacheDir) {
 
+#ifdef ORC_JIT
+  std::unique_ptr<DiskObjectCache> Cache;
+  if(!ObjectCacheDir.empty())
+    Cache = std::make_unique<DiskObjectCache>(ObjectCacheDir, CGLevel, UseFastISel, UseIPRA);
+
+  void *Address = OrcSession::get().compile(Name, Globals, *M, CGLevel,
+                                            UseFastISel, UseIPRA, Cache.get());
+  assert(Address != 0);
+
+  std::unique_ptr<LLVMHolder> Holder(new easy::LLVMHolderImpl{std::move(M), std::move(LLVMCxt)});
+  return std::unique_ptr<Function>(new Function(Address, std::move(Holder)));
+#else
   llvm::Module* MPtr = M.get();
   std::unique_ptr<llvm::ExecutionEngine> EE = GetEngine(std::move(M), Name, CGLevel, UseFastISel, UseIPRA);
 
@@ -94,24 +210,38 @@ Function::CompileAndWrap(const char*Name, GlobalMapping* Globals,
     MapGlobals(*EE, Globals);
   }
 
+  // the object is generated when the address is first requested.
+  std::unique_ptr<DiskObjectCache> Cache;
+  if(!ObjectCacheDir.empty()) {
+    Cache = std::make_unique<DiskObjectCache>(ObjectCacheDir, CGLevel, UseFastISel, UseIPRA);
+    EE->setObjectCache(Cache.get());
+  }
+
   void *Address = (void*)EE->getFunctionAddress(Name);
 
+  if(Cache)
+    EE->setObjectCache(nullptr);
+
   assert(Address != 0);
 
   std::unique_ptr<LLVMHolder> Holder(new easy::LLVMHolderImpl{std::move(EE), std::move(LLVMCxt), MPtr});
   return std::unique_ptr<Function>(new Function(Address, std::move(Holder)));
+#endif
+}
+
+std::unique_ptr<llvm::Module> Function::getLLVMModule(llvm::LLVMContext &C) const {
+  return static_cast<LLVMHolderImpl&>(*this->Holder).copyModule(C);
 }
 
-llvm::Module const& Function::getLLVMModule() const {
-  return *static_cast<LLVMHolderImpl const&>(*this->Holder).M_;
+void Function::releaseIR() {
+  static_cast<LLVMHolderImpl&>(*this->Holder).releaseIR();
 }
 
 void easy::Function::serialize(std::ostream& os) const {
   std::string buf;
   llvm::raw_string_ostream stream(buf);
 
-  LLVMHolderImpl const *H = reinterpret_cast<LLVMHolderImpl const*>(Holder.get());
-  llvm::WriteBitcodeToFile(PASS_MODULE_ARG(*(H->M_)), stream);
+  static_cast<LLVMHolderImpl&>(*Holder).writeBitcode(stream);
   stream.flush();
 
   os << buf;
@@ -147,13 +277,11 @@ std::unique_ptr<easy::Function> easy::Function::deserialize(std::istream& is) {
 }
 
 bool Function::operator==(easy::Function const& other) const {
-  LLVMHolderImpl& This = static_cast<LLVMHolderImpl&>(*this->Holder);
-  LLVMHolderImpl& Other = static_cast<LLVMHolderImpl&>(*other.Holder);
-  return This.M_ == Other.M_;
+  // each holder owns a distinct module, even while its IR is released.
+  return this->Holder.get() == other.Holder.get();
 }
 
 std::hash<easy::Function>::result_type
 std::hash<easy::Function>::operator()(argument_type const& F) const noexcept {
-  LLVMHolderImpl& This = static_cast<LLVMHolderImpl&>(*F.Holder);
-  return std::hash<llvm::Module*>{}(This.M_);
+  return std::hash<easy::LLVMHolder*>{}(F.Holder.get());
 }
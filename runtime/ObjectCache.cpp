@@ -0,0 +1,97 @@
+#include <easy/runtime/ObjectCache.h>
+#include <easy/runtime/Compat.h>
+
+#include <llvm/IR/Module.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <loguru.hpp>
+
+#include <atomic>
+
+using namespace easy;
+
+namespace {
+  std::atomic<uint64_t> Hits{0};
+  std::atomic<uint64_t> Misses{0};
+}
+
+uint64_t DiskObjectCache::hits() {
+  return Hits.load();
+}
+
+uint64_t DiskObjectCache::misses() {
+  return Misses.load();
+}
+
+DiskObjectCache::DiskObjectCache(std::string const &Dir, llvm::CodeGenOpt::Level CGLevel,
+                                 bool UseFastISel, bool UseIPRA) : Dir_(Dir) {
+  llvm::raw_string_ostream Salt(Salt_);
+  Salt << LLVM_VERSION_STRING << ";" << llvm::sys::getProcessTriple()
+       << ";" << llvm::sys::getHostCPUName()
+       << ";" << (int) CGLevel << ";" << UseFastISel << ";" << UseIPRA;
+  Salt.flush();
+}
+
+std::string DiskObjectCache::getKey(llvm::Module const* M) {
+  llvm::SmallVector<char, 0> Bitcode;
+  llvm::raw_svector_ostream Out(Bitcode);
+  llvm::WriteBitcodeToFile(PASS_MODULE_ARG(*M), Out);
+
+  llvm::MD5 Hash;
+  Hash.update(llvm::StringRef(Bitcode.data(), Bitcode.size()));
+  Hash.update(Salt_);
+
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  return std::string(Result.digest().str());
+}
+
+std::string DiskObjectCache::getPath(std::string const &Key) const {
+  llvm::SmallString<128> Path(Dir_);
+  llvm::sys::path::append(Path, Key + ".o");
+  return std::string(Path.str());
+}
+
+std::unique_ptr<llvm::MemoryBuffer> DiskObjectCache::getObject(const llvm::Module* M) {
+  // codegen may modify the module before notifyObjectCompiled is called,
+  // so we must remember the key from now.
+  Key_ = getKey(M);
+
+  auto BufOrErr = llvm::MemoryBuffer::getFile(getPath(Key_), /*FileSize=*/-1,
+                                              /*RequiresNullTerminator=*/false);
+  if (!BufOrErr)
+    return nullptr;
+
+  Hits += 1;
+  DLOG_S(INFO) << "loaded cached object " << Key_;
+  return std::move(BufOrErr.get());
+}
+
+void DiskObjectCache::notifyObjectCompiled(const llvm::Module* M, llvm::MemoryBufferRef Obj) {
+  Misses += 1;
+
+  if (Key_.empty() || llvm::sys::fs::create_directories(Dir_))
+    return;
+
+  // write to a unique temporary file first, so that concurrent
+  // writers and readers of the same object never see a partial file.
+  llvm::SmallString<128> TmpPath;
+  int FD;
+  if (llvm::sys::fs::createUniqueFile(getPath(Key_) + ".tmp%%%%%%", FD, TmpPath))
+    return;
+
+  {
+    llvm::raw_fd_ostream Out(FD, /*shouldClose=*/true);
+    Out << Obj.getBuffer();
+  }
+
+  if (llvm::sys::fs::rename(TmpPath, getPath(Key_)))
+    llvm::sys::fs::remove(TmpPath);
+}
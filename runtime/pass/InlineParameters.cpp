@@ -151,13 +151,11 @@ void GetInlineArgs(easy::Context const &C, FunctionType& OldTy, Function &Wrappe
 
       case easy::ArgumentBase::AK_Module: {
         easy::Function const &Function = Arg.as<easy::ModuleArgument>()->get();
-        llvm::Module const& FunctionModule = Function.getLLVMModule();
-        auto FunctionName = easy::GetEntryFunctionName(FunctionModule);
-
         std::unique_ptr<llvm::Module> LM =
-            easy::CloneModuleWithContext(FunctionModule, Wrapper.getContext());
+            Function.getLLVMModule(Wrapper.getContext());
 
         assert(LM);
+        auto FunctionName = easy::GetEntryFunctionName(*LM);
 
         easy::UnmarkEntry(*LM);
 
@@ -0,0 +1,68 @@
+#include <tuner/Clock.h>
+
+#include <cmath>
+
+#ifdef ATJIT_HAS_TSC
+#include <cpuid.h>
+#endif
+
+namespace tuner {
+
+namespace {
+#ifdef ATJIT_HAS_TSC
+  // the TSC must tick at a constant rate, regardless of power states,
+  // and rdtscp must be available.
+  bool hasInvariantTSC() {
+    unsigned A, B, C, D;
+    if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007)
+      return false;
+
+    if (!__get_cpuid(0x80000001, &A, &B, &C, &D) || !(D & (1U << 27)))
+      return false;
+
+    if (!__get_cpuid(0x80000007, &A, &B, &C, &D))
+      return false;
+
+    return D & (1U << 8);
+  }
+#endif
+
+  const std::chrono::microseconds CalibrationTime(2'000);
+} // end anonymous namespace
+
+Clock::Calibration Clock::calibrate() {
+  Calibration Calib;
+
+#ifdef ATJIT_HAS_TSC
+  if (!hasInvariantTSC())
+    return Calib;
+
+  using steady = std::chrono::steady_clock;
+
+  // count the ticks over a short span of steady_clock time.
+  auto Start = steady::now();
+  uint64_t StartTicks = __rdtsc();
+
+  steady::time_point End;
+  do {
+    End = steady::now();
+  } while (End - Start < CalibrationTime);
+  uint64_t EndTicks = __rdtsc();
+
+  std::chrono::duration<double, std::nano> Elapsed = End - Start;
+  if (EndTicks <= StartTicks)
+    return Calib;
+
+  double NanosPerTick = Elapsed.count() / (EndTicks - StartTicks);
+
+  Calib.UseTSC = true;
+  Calib.TickBase = EndTicks;
+  Calib.NanoBase = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      End.time_since_epoch()).count();
+  Calib.Mult = (uint64_t) std::llround(NanosPerTick * 4294967296.0);
+#endif
+
+  return Calib;
+}
+
+} // end namespace
@@ -0,0 +1,55 @@
+#include <tuner/Epochs.h>
+
+namespace tuner {
+
+namespace {
+  // gives up the thread's record when it exits.
+  struct Releaser {
+    Epochs::Record* R = nullptr;
+
+    ~Releaser() {
+      if (!R)
+        return;
+      R->Epoch.store(0, std::memory_order_release);
+      R->Taken.store(false, std::memory_order_release);
+    }
+  };
+
+  thread_local Releaser ThisThread;
+} // end anonymous namespace
+
+  // records are never freed, but those of exited threads are reused, so
+  // there are only as many as the most threads that were alive at once.
+  Epochs::Record* Epochs::acquireRecord() {
+    Record* R = nullptr;
+
+    for (Record* It = Head_.load(std::memory_order_acquire); It; It = It->Next) {
+      bool Taken = false;
+      if (It->Taken.compare_exchange_strong(Taken, true, std::memory_order_acquire)) {
+        R = It;
+        break;
+      }
+    }
+
+    if (!R) {
+      R = new Record();
+      R->Next = Head_.load(std::memory_order_relaxed);
+      while (!Head_.compare_exchange_weak(R->Next, R, std::memory_order_release));
+    }
+
+    ThisThread.R = R;
+    return R;
+  }
+
+  bool Epochs::quiescent(uint64_t Retired) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    for (Record* It = Head_.load(std::memory_order_acquire); It; It = It->Next) {
+      uint64_t Local = It->Epoch.load(std::memory_order_seq_cst);
+      if (Local != 0 && Local < Retired)
+        return false;
+    }
+    return true;
+  }
+
+} // end namespace
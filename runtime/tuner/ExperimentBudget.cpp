@@ -0,0 +1,72 @@
+#include <tuner/ExperimentBudget.h>
+#include <tuner/Util.h>
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+
+namespace tuner {
+
+namespace {
+  int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  const int64_t WindowNs = EXPERIMENT_BUDGET_WINDOW_S * 1'000'000'000LL;
+} // end anonymous namespace
+
+  void ExperimentBudget::setCompileSecsPerMin(double Secs) {
+    CompileSecsPerMin_ = Secs;
+    ZeroTokensAt_ = 0; // start with a full bucket.
+  }
+
+  bool ExperimentBudget::trialAllowed(uint64_t TrialTime, uint64_t BestTime) const {
+    double Fraction = TrialFraction_.load(std::memory_order_relaxed);
+    if (Fraction < 0)
+      return true;
+
+    uint64_t Total = TrialTime + BestTime;
+    if (Total == 0)
+      return Fraction > 0;
+
+    // strictly, so that a fraction of 0 never allows an experiment.
+    return TrialTime < Fraction * Total;
+  }
+
+  bool ExperimentBudget::compileAllowed() const {
+    double Secs = CompileSecsPerMin_.load(std::memory_order_relaxed);
+    if (Secs < 0)
+      return true;
+    if (Secs == 0)
+      return false;
+
+    return ZeroTokensAt_.load(std::memory_order_relaxed) <= now();
+  }
+
+  void ExperimentBudget::chargeCompile(uint64_t Nanos) {
+    CompileTime_ += Nanos;
+
+    double Secs = CompileSecsPerMin_.load(std::memory_order_relaxed);
+    if (Secs <= 0)
+      return;
+
+    // refilling the bucket by the spent time takes this long.
+    int64_t Refill = Nanos * (EXPERIMENT_BUDGET_WINDOW_S / Secs);
+
+    // a bucket that was already full does not hold more than a window's worth.
+    int64_t Floor = now() - WindowNs;
+    int64_t Zero = ZeroTokensAt_.load(std::memory_order_relaxed);
+    while (!ZeroTokensAt_.compare_exchange_weak(Zero, std::max(Zero, Floor) + Refill,
+                                                std::memory_order_relaxed))
+      ;
+  }
+
+  uint64_t ExperimentBudget::threadCPUTime() {
+    struct timespec TS;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &TS) != 0)
+      return 0;
+    return TS.tv_sec * 1'000'000'000ULL + TS.tv_nsec;
+  }
+
+} // end namespace
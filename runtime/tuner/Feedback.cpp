@@ -1,23 +1,201 @@
 #include <tuner/Feedback.h>
 #include <loguru.hpp>
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 
 namespace tuner {
 
-template <typename Duration = std::chrono::nanoseconds>
-int64_t elapsedTime(Feedback::TimePoint Start, Feedback::TimePoint End) {
-  Duration elapsedDur = (End - Start);
-  return elapsedDur.count();
+namespace {
+  // the continued fraction of the incomplete beta function, evaluated with
+  // the modified Lentz method (Numerical Recipes, 6.4).
+  double betaContinuedFraction(double a, double b, double x) {
+    const int MaxIter = 300;
+    const double Eps = 1e-15, Tiny = 1e-300;
+
+    double qab = a + b, qap = a + 1, qam = a - 1;
+    double c = 1, d = 1 - qab * x / qap;
+    if (std::fabs(d) < Tiny)
+      d = Tiny;
+    d = 1 / d;
+    double h = d;
+
+    for (int m = 1; m <= MaxIter; m++) {
+      int m2 = 2 * m;
+      double aa = m * (b - m) * x / ((qam + m2) * (a + m2));
+      d = 1 + aa * d;
+      if (std::fabs(d) < Tiny)
+        d = Tiny;
+      c = 1 + aa / c;
+      if (std::fabs(c) < Tiny)
+        c = Tiny;
+      d = 1 / d;
+      h *= d * c;
+
+      aa = -(a + m) * (qab + m) * x / ((a + m2) * (qap + m2));
+      d = 1 + aa * d;
+      if (std::fabs(d) < Tiny)
+        d = Tiny;
+      c = 1 + aa / c;
+      if (std::fabs(c) < Tiny)
+        c = Tiny;
+      d = 1 / d;
+      double del = d * c;
+      h *= del;
+      if (std::fabs(del - 1) < Eps)
+        break;
+    }
+    return h;
+  }
+
+  // the regularized incomplete beta function I_x(a, b).
+  double incompleteBeta(double a, double b, double x) {
+    if (x <= 0)
+      return 0;
+    if (x >= 1)
+      return 1;
+
+    double front = std::exp(std::lgamma(a + b) - std::lgamma(a) - std::lgamma(b)
+                            + a * std::log(x) + b * std::log(1 - x));
+
+    if (x < (a + 1) / (a + b + 2))
+      return front * betaContinuedFraction(a, b, x) / a;
+    return 1 - front * betaContinuedFraction(b, a, 1 - x) / b;
+  }
+
+  double studentCDF(double t, double df) {
+    double tail = 0.5 * incompleteBeta(df / 2, 0.5, df / (df + t * t));
+    return t > 0 ? 1 - tail : tail;
+  }
+
+  // the x in [lo, hi] where the increasing function CDF reaches p.
+  template <typename Fn>
+  double invert(Fn &&CDF, double p, double lo, double hi) {
+    for (int i = 0; i < 100; i++) {
+      double mid = (lo + hi) / 2;
+      if (CDF(mid) < p)
+        lo = mid;
+      else
+        hi = mid;
+    }
+    return (lo + hi) / 2;
+  }
+
+  // the one-sided critical values of the t test at a significance level.
+  // Those for small degrees of freedom are computed once, and beyond
+  // that the normal distribution is close enough.
+  class CriticalValues {
+    static constexpr int TableSize = 200;
+    std::vector<double> Table;
+    double Normal;
+
+  public:
+    CriticalValues(double alpha)
+        : Table(TableSize + 1), Normal(normalQuantile(1 - alpha)) {
+      for (int i = 1; i <= TableSize; i++)
+        Table[i] = studentQuantile(1 - alpha, i);
+    }
+
+    double operator()(double df) const {
+      if (df > TableSize)
+        return Normal;
+      return Table[std::max(1, (int) df)];
+    }
+  };
+
+  struct CriticalTables {
+    CriticalValues Better{BETTER_THAN_ALPHA};
+    CriticalValues Abandon{ABANDON_ALPHA};
+  };
+
+  CriticalTables const& criticalTables() {
+    static const CriticalTables Tables;
+    return Tables;
+  }
+
+  // the levels used by the driver are tabulated, since it runs the
+  // test while deciding what to serve.
+  double criticalT(double df, double alpha) {
+    if (alpha == BETTER_THAN_ALPHA)
+      return criticalTables().Better(df);
+    if (alpha == ABANDON_ALPHA)
+      return criticalTables().Abandon(df);
+    return studentQuantile(1 - alpha, df);
+  }
+} // end anonymous namespace
+
+void prepareCriticalValues() {
+  criticalTables();
+}
+
+double normalQuantile(double p) {
+  return invert([](double x) { return 0.5 * std::erfc(-x / std::sqrt(2.0)); },
+                p, -40, 40);
+}
+
+double studentQuantile(double p, double df) {
+  return invert([df](double t) { return studentCDF(t, df); }, p, -1e6, 1e6);
+}
+
+bool mannWhitneyLower(std::vector<double> const& Mine,
+                      std::vector<double> const& Theirs, double alpha) {
+  const double n1 = Mine.size(), n2 = Theirs.size();
+  if (n1 == 0 || n2 == 0)
+    return false;
+
+  std::vector<std::pair<double, bool>> All; // (value, is mine)
+  for (double V : Mine)
+    All.emplace_back(V, true);
+  for (double V : Theirs)
+    All.emplace_back(V, false);
+  std::sort(All.begin(), All.end());
+
+  // rank the values, giving tied values the average of their ranks.
+  double MyRanks = 0, TieSum = 0;
+  for (size_t i = 0; i < All.size(); ) {
+    size_t j = i;
+    while (j < All.size() && All[j].first == All[i].first)
+      j++;
+
+    double Rank = (i + 1 + j) / 2.0;
+    for (size_t k = i; k < j; k++)
+      if (All[k].second)
+        MyRanks += Rank;
+
+    double Ties = j - i;
+    TieSum += Ties * Ties * Ties - Ties;
+    i = j;
+  }
+
+  // U counts the pairs where my value is the larger one.
+  const double N = n1 + n2;
+  double U = MyRanks - n1 * (n1 + 1) / 2;
+  double Mean = n1 * n2 / 2;
+  double Var = n1 * n2 / 12 * ((N + 1) - TieSum / (N * (N - 1)));
+  if (Var <= 0)
+    return false;
+
+  // with continuity correction, using the normal approximation.
+  double Z = (Mean - U - 0.5) / std::sqrt(Var);
+  return Z >= normalQuantile(1 - alpha);
 }
 
-// NOTE: This implementation assumes that the sample
-// data in each Feedback object is normally distributed.
-bool Feedback::betterThan(Feedback& Other) {
+// NOTE: unless both sides keep their samples for a non-parametric test,
+// this assumes that the sample data in each Feedback object is
+// normally distributed.
+bool Feedback::betterThan(Feedback& Other, double alpha, double margin) {
   this->updateStats();
   Other.updateStats();
 
+  std::vector<double> MySamples, OtherSamples;
+  if (this->keptSamples(MySamples) && Other.keptSamples(OtherSamples)) {
+    // my values must be lower than theirs, less the margin.
+    for (double &V : OtherSamples)
+      V *= 1 - margin;
+    return mannWhitneyLower(MySamples, OtherSamples, alpha);
+  }
+
   /*
     We perform a two-sample t test aka Welch's unequal variances t-test.
     More details:
@@ -48,7 +226,7 @@ bool Feedback::betterThan(Feedback& Other) {
   size_t o_sz = Other.sampleSize();
   double o_scaledVar = o_var / o_sz;
 
-  const double DELTA = 0.02 * o_mean; // delta is defined as a % of their mean.
+  const double DELTA = margin * o_mean; // delta is defined as a % of their mean.
 
   double test_statistic = (o_mean - my_mean - DELTA) /
                           std::sqrt(o_scaledVar + my_scaledVar);
@@ -62,19 +240,15 @@ bool Feedback::betterThan(Feedback& Other) {
 
   DLOG_F(INFO, "delta = %.3f, ts = %.3f, df = %.1f", DELTA, test_statistic, df);
 
-  // TODO: determine the _correct_ critical values
-  // for a given confidence level to determine
-  // whether to reject null hyp.
+  // with too little data, nothing can be concluded.
+  if (!(df >= 1))
+    return false;
 
-  // hardcode alpha = 0.05, df = 6
-  const double THRESH = 1.943;
-
-  return test_statistic >= THRESH;
+  return test_statistic >= criticalT(df, alpha);
 }
 
 void calculateBasicStatistics(
-                                std::vector<Feedback::TimePoint>& startBuf,
-                                std::vector<Feedback::TimePoint>& endBuf,
+                                std::vector<double>& elapsedBuf,
                                 size_t sampleSz,
                                 double& sampleAvg,
                                 double& sampleVariance,
@@ -84,17 +258,15 @@ void calculateBasicStatistics(
   CHECK_F(sampleSz > 0, "calculating statistics when there is no data.");
 
   { // compute sample average
-    int64_t totalTime = 0;
+    double totalTime = 0;
     for (size_t i = 0; i < sampleSz; i++) {
-      int64_t obsTime = elapsedTime(startBuf[i], endBuf[i]);
+      double obsTime = elapsedBuf[i];
 
       DCHECK_F(obsTime > 0, "saw bogus sample time!");
-      DCHECK_F(std::numeric_limits<int64_t>::max() - totalTime > obsTime,
-                        "overflow. use a different time unit!");
 
       totalTime += obsTime;
     }
-    sampleAvg = ((double) totalTime) / sampleSz;
+    sampleAvg = totalTime / sampleSz;
   }
 
   { // compute sample variance and standard error of the mean
@@ -102,16 +274,62 @@ void calculateBasicStatistics(
       sampleVariance = 0;
       sampleErr = 0;
     } else {
-      int64_t sumSqDiff = 0;
+      double sumSqDiff = 0;
       for (size_t i = 0; i < sampleSz; i++) {
-        sumSqDiff += std::pow(elapsedTime(startBuf[i], endBuf[i]) - sampleAvg, 2);
+        sumSqDiff += std::pow(elapsedBuf[i] - sampleAvg, 2);
       }
-      sampleVariance = ((double) sumSqDiff) / (sampleSz - 1);
+      sampleVariance = sumSqDiff / (sampleSz - 1);
       sampleErr = std::sqrt(sampleVariance) / std::sqrt(sampleSz);
     }
   }
 }
 
+RobustSummary summarizeRobust(std::vector<double>& samples,
+                              std::vector<double>& kept) {
+  RobustSummary RS;
+  kept.clear();
+  if (samples.empty())
+    return RS;
+
+  auto medianOf = [](std::vector<double>& V) {
+    size_t Mid = V.size() / 2;
+    std::nth_element(V.begin(), V.begin() + Mid, V.end());
+    double Hi = V[Mid];
+    if (V.size() % 2)
+      return Hi;
+    double Lo = *std::max_element(V.begin(), V.begin() + Mid);
+    return (Lo + Hi) / 2;
+  };
+
+  RS.median = medianOf(samples);
+
+  std::vector<double> Deviations;
+  for (double V : samples)
+    Deviations.push_back(std::fabs(V - RS.median));
+
+  // 1.4826 scales the MAD to match the std deviation of normal data.
+  double Limit = OUTLIER_MADS * 1.4826 * medianOf(Deviations);
+
+  for (double V : samples)
+    if (Limit == 0 || std::fabs(V - RS.median) <= Limit)
+      kept.push_back(V);
+  RS.outliers = samples.size() - kept.size();
+
+  std::sort(kept.begin(), kept.end());
+  size_t Trim = (size_t) (kept.size() * TRIM_FRACTION);
+  double Sum = 0;
+  for (size_t i = Trim; i < kept.size() - Trim; i++)
+    Sum += kept[i];
+  RS.trimmedMean = Sum / (kept.size() - 2 * Trim);
+
+  if (kept.size() >= 2) {
+    double Avg, StdErr;
+    calculateBasicStatistics(kept, kept.size(), Avg, RS.variance, StdErr);
+  }
+
+  return RS;
+}
+
 
 std::shared_ptr<Feedback> createFeedback(FeedbackKind requested,
                                         std::optional<FeedbackKind> preferred) {
@@ -131,6 +349,15 @@ std::shared_ptr<Feedback> createFeedback(FeedbackKind requested,
     case FB_Recent:
       return std::make_shared<RecentExecutionTime>();
 
+    case FB_Sampled:
+      return std::make_shared<SampledExecutionTime>();
+
+    case FB_Cycles:
+      return std::make_shared<CycleCounts>();
+
+    case FB_Robust:
+      return std::make_shared<RobustExecutionTime>();
+
     case FB_Recent_NP:
     default:
       throw std::runtime_error("createFeedback -- unknown feedback kind!");
@@ -1,4 +1,6 @@
 #include <tuple>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 #include <loguru.hpp>
@@ -38,40 +40,63 @@ namespace tuner {
 
   std::once_flag Optimizer::haveInitPollyPasses_ = std::once_flag();
 
-  // generates a fresh PassManager to optimize the module.
-  // This MPM should be generated _after_ the Tuner has applied a configuration
-  // to the KnobSet!
-  std::unique_ptr<llvm::legacy::PassManager> Optimizer::genPassManager() {
+  // generates a fresh PassManager that specializes the module to the
+  // Context, e.g., by inlining the values of the tuned parameters. This MPM
+  // must be run _after_ the Tuner has applied a configuration to the KnobSet,
+  // and before the next configuration is applied!
+  std::unique_ptr<llvm::legacy::PassManager> Optimizer::genSpecializer() {
     auto &BT = easy::BitcodeTracker::GetTracker();
     const char* Name = BT.getName(Addr_);
 
-    unsigned OptLevel = OptLvl.getVal();
-    unsigned OptSize = OptSz.getVal();
+    auto MPM = std::make_unique<llvm::legacy::PassManager>();
+
+    // We absolutely must run this first!
+    MPM->add(easy::createContextAnalysisPass(Cxt_));
+    MPM->add(easy::createInlineParametersPass(Name));
+
+    return MPM;
+  }
+
+  // takes a snapshot of the knobs that control the rest of the compilation,
+  // so that the next configuration can be applied while this one is compiled.
+  PipelineOptions Optimizer::snapshotOptions() {
+    PipelineOptions Opts;
+    Opts.OptLevel = OptLvl.getVal();
+    Opts.OptSize = OptSz.getVal();
+    Opts.InlineThreshold = InlineThresh.getVal();
+    Opts.CGLevel = CGOptLvl.getLevel();
+    Opts.FastISel = FastISelOpt.getFlag();
+    Opts.IPRA = IPRAOpt.getFlag();
+    return Opts;
+  }
+
+  // generates a fresh PassManager to optimize a specialized module.
+  // The TargetMachine must outlive the MPM.
+  std::unique_ptr<llvm::legacy::PassManager>
+    Optimizer::genPassManager(PipelineOptions const &Opts, llvm::TargetMachine &TM) {
+    auto &BT = easy::BitcodeTracker::GetTracker();
+    const char* Name = BT.getName(Addr_);
 
     llvm::Triple Triple{llvm::sys::getProcessTriple()};
 
     llvm::PassManagerBuilder Builder;
-    Builder.OptLevel = OptLevel;
-    Builder.SizeLevel = OptSize;
+    Builder.OptLevel = Opts.OptLevel;
+    Builder.SizeLevel = Opts.OptSize;
     Builder.LibraryInfo = new llvm::TargetLibraryInfoImpl(Triple);
-    Builder.Inliner = llvm::createFunctionInliningPass(InlineThresh.getVal());
+    Builder.Inliner = llvm::createFunctionInliningPass(Opts.InlineThreshold);
 
 #ifndef NDEBUG
     Builder.VerifyInput = true;
     Builder.VerifyOutput = true;
 #endif
 
-    TM_ = GetHostTargetMachine();
-    assert(TM_);
-    TM_->adjustPassManager(Builder);
+    TM.adjustPassManager(Builder);
 
     auto MPM = std::make_unique<llvm::legacy::PassManager>();
 
-    MPM->add(llvm::createTargetTransformInfoWrapperPass(TM_->getTargetIRAnalysis()));
+    MPM->add(llvm::createTargetTransformInfoWrapperPass(TM.getTargetIRAnalysis()));
 
-    // We absolutely must run this first!
     MPM->add(easy::createContextAnalysisPass(Cxt_));
-    MPM->add(easy::createInlineParametersPass(Name));
 
     // After some cleanup etc, run devirtualization.
     Builder.addExtension(llvm::PassManagerBuilder::EP_ScalarOptimizerLate,
@@ -99,13 +124,16 @@ namespace tuner {
   }
 
   void Optimizer::findContextKnobs(KnobSet &KS) {
+    unsigned ParamNum = 0;
     for (std::shared_ptr<easy::ArgumentBase> AB : *Cxt_) {
+      ParamNum++;
       switch(AB->kind()) {
 
         case easy::ArgumentBase::AK_IntRange: {
           auto const* IntArg = AB->as<easy::IntRangeArgument>();
           auto *ScalarKnob = static_cast<knob_type::ScalarInt*>(IntArg->get());
           KS.IntKnobs[ScalarKnob->getID()] = ScalarKnob;
+          ParamNames_[ScalarKnob->getID()] = "param #" + std::to_string(ParamNum);
         } break;
 
         case easy::ArgumentBase::AK_Forward:
@@ -121,36 +149,42 @@ namespace tuner {
     }
   }
 
-  // currently, this constructor is called every time we query the ATDriver's
-  // state map, because of how unordered_map is setup. Thus, you'll want to
-  // call "initialize" once the object is known to be needed to actually
-  // get it setup, since the work is non-trivial.
+  // the ATDriver only constructs an optimizer when it first encounters a
+  // function + context. It still passes LazyInit, so that the non-trivial
+  // work of "initialize" happens outside of the driver's state lock.
   Optimizer::Optimizer(void* Addr,
                        std::shared_ptr<easy::Context> Cxt,
-                       bool LazyInit)
+                       bool LazyInit,
+                       std::shared_ptr<TuningDB> DB,
+                       std::shared_ptr<ExperimentBudget> Budget)
                        : Cxt_(Cxt), Addr_(Addr), InitializedSelf_(false),
-                         Tuner_(nullptr) {
+                         Tuner_(nullptr), DB_(std::move(DB)),
+                         Budget_(std::move(Budget)) {
         if (!LazyInit)
           initialize();
       }
 
   Optimizer::~Optimizer() {
-    // first we need to make sure no concurrent compiles are still running
-    if (recompileActive_) {
-      DLOG_S(INFO) << "optimizer's destructor is waiting for compile threads to finish.";
+    // first we need to make sure no concurrent compiles are still running.
+    // we wait on the group even if no compiles are pending, since a codegen
+    // job may still be wrapping up after adding its result to the list.
+    if (InitializedSelf_) {
+      // nobody will use the results of compile-ahead jobs now.
+      stopCompilingAhead_ = true;
 
-      while (recompileActive_)
-        sleep_for(1);
+      if (pendingCompiles_ > 0)
+        DLOG_S(INFO) << "optimizer's destructor is waiting for compile threads to finish.";
 
-      DLOG_S(INFO) << "NOTE: compile threads flushed.\n";
+      dispatch_group_wait(compileJobs_, DISPATCH_TIME_FOREVER);
     }
 
     delete Tuner_;
 
     if (InitializedSelf_) {
       // we're not using ARC, so we need to manually deallocate the queues.
+      // the pipeline and codegen queues are global queues, which are never released.
       dispatch_release(optimizeQ_);
-      dispatch_release(codegenQ_);
+      dispatch_release(compileJobs_);
       dispatch_release(mutate_recompileDone_);
     }
   }
@@ -162,6 +196,13 @@ namespace tuner {
 
     DLOG_S(INFO) << "initializing optimizer\n";
 
+#ifdef ORC_JIT
+    // the ORC session never frees the code of a version,
+    // so a code-only version would not keep its promise.
+    if (Cxt_->getCodeOnly())
+      throw CodeOnlyUnsupported(easy::BitcodeTracker::GetTracker().getName(Addr_));
+#endif
+
 #ifdef POLLY_KNOBS
   std::call_once(haveInitPollyPasses_, [] {
     polly::PollyProcessUnprofitable = true;
@@ -176,13 +217,14 @@ namespace tuner {
     // initialize concurrency stuff
     optimizeQ_ = dispatch_queue_create("atJIT.optimizeQ", NULL);
 
-    codegenQ_ = dispatch_queue_create("atJIT.codegenQ", NULL);
+    pipelineQ_ = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0);
 
-    // FIXME: we should be able to parallelize this queue.
-    // one of the difficulties is that recompileActive can get
-    // set to false before all recompile jobs are flushed.
-    //
-    // codegenQ_ = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0);
+    // codegen jobs for independently optimized modules can run in parallel,
+    // so completion is tracked with the pendingCompiles_ counter instead of
+    // relying on the order in which jobs finish.
+    codegenQ_ = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0);
+
+    compileJobs_ = dispatch_group_create();
 
     mutate_recompileDone_ = dispatch_queue_create("atJIT.mutate_recompileDone", NULL);
 
@@ -258,9 +300,87 @@ namespace tuner {
         Tuner_ = new NoOpTuner(std::move(KS));
     };
 
+    // start from the best config of a prior run, if there is one.
+    if (!isNoopTuner_) {
+      std::optional<TuningRecord> Rec;
+      if (DB_)
+        Rec = DB_->lookup(tuningKey());
+      if (!Rec)
+        Rec = Seed_;
+      if (Rec)
+        Tuner_->seed([this, Rec] (KnobSet const& KS) {
+          return seedFromRecord(Rec.value(), KS);
+        });
+    }
+
     InitializedSelf_ = true;
   }
 
+  // knobs missing from the record, e.g., because they were added since
+  // then, are left at their default.
+  KnobConfig Optimizer::seedFromRecord(TuningRecord const& Rec, KnobSet const& KS) const {
+    KnobConfig KC = genDefaultConfig(KS);
+
+    for (auto const& Entry : KS.IntKnobs) {
+      auto *Knob = Entry.second;
+      auto Found = Rec.IntConfig.find(knobName(*Knob));
+      if (Found != Rec.IntConfig.end())
+        KC.IntConfig[Entry.first] = std::clamp(Found->second, Knob->min(), Knob->max());
+    }
+
+    for (auto const& Entry : KS.LoopKnobs) {
+      auto Found = Rec.LoopConfig.find(knobName(*Entry.second));
+      if (Found != Rec.LoopConfig.end())
+        KC.LoopConfig[Entry.first] = Found->second;
+    }
+
+    return KC;
+  }
+
+  std::string Optimizer::tuningKey() const {
+    return TuningDB::makeKey(std::get<0>(GMap_), *Cxt_) + Variant_;
+  }
+
+  std::optional<TuningRecord> Optimizer::bestRecord() {
+    if (!InitializedSelf_ || isNoopTuner_)
+      return std::nullopt;
+
+    auto Best = Tuner_->bestSeenSync();
+    if (!Best.has_value())
+      return std::nullopt;
+
+    KnobConfig const& KC = *Best.value().first;
+    Feedback const& FB = *Best.value().second;
+
+    // nothing worth keeping has been measured yet.
+    if (FB.sampleSize() == 0 || std::isnan(FB.expectedValue()))
+      return std::nullopt;
+
+    KnobSet const& KS = Tuner_->getKnobSet();
+    TuningRecord Rec;
+    Rec.ExpectedValue = FB.expectedValue();
+
+    for (auto const& Entry : KC.IntConfig) {
+      auto Knob = KS.IntKnobs.find(Entry.first);
+      if (Knob != KS.IntKnobs.end())
+        Rec.IntConfig[knobName(*Knob->second)] = Entry.second;
+    }
+
+    for (auto const& Entry : KC.LoopConfig) {
+      auto Knob = KS.LoopKnobs.find(Entry.first);
+      if (Knob != KS.LoopKnobs.end())
+        Rec.LoopConfig[knobName(*Knob->second)] = Entry.second;
+    }
+
+    return Rec;
+  }
+
+  void Optimizer::saveTuning(TuningDB &DB) {
+    auto Rec = bestRecord();
+    if (Rec)
+      DB.update(tuningKey(), std::move(Rec.value()));
+  }
+
   easy::Context const* Optimizer::getContext() const {
     return Cxt_.get();
   }
@@ -281,10 +401,20 @@ namespace tuner {
       Opt->optimize_callback();
     }
 
+    void pipelinesDoneTask(void* P) {
+      Optimizer* Opt = static_cast<Optimizer*>(P);
+      Opt->pipelinesDone_callback();
+    }
+
+    void pipelineTask(void* P) {
+      CompileJob* Job = static_cast<CompileJob*>(P);
+      Job->Opt->pipeline_callback(Job);
+    }
+
     void codegenTask(void* P) {
-      OptimizeResult* OR = static_cast<OptimizeResult*>(P);
-      OR->Opt->codegen_callback(OR);
-      delete OR;
+      CompileJob* Job = static_cast<CompileJob*>(P);
+      Job->Opt->codegen_callback(Job);
+      delete Job;
     }
 
     // list tasks
@@ -307,7 +437,12 @@ namespace tuner {
   // NOTE: must be holding mutate_recompileDone_ queue!
   void Optimizer::addToList_callback(AddCompileResult* ACR) {
     recompileDone_.push_back(std::move(ACR->Result));
-    doneQueueEmpty_ = false;
+
+    {
+      std::lock_guard<std::mutex> Guard(resultAddedLock_);
+      doneQueueEmpty_ = false;
+    }
+    resultAdded_.notify_all();
   }
 
   // tries once to pop a compile result off the ready list.
@@ -332,7 +467,7 @@ namespace tuner {
 
   opt_status::Value Optimizer::status() const {
     if (doneQueueEmpty_) {
-      if (recompileActive_)
+      if (pendingCompiles_ > 0)
         return opt_status::Working;
       else
         return opt_status::Empty;
@@ -357,30 +492,28 @@ namespace tuner {
 
     if (R.RetVal.has_value() == false) {
 
-      if (recompileActive_ == false) {
+      if (pendingCompiles_ == 0) {
         // start a compile job
-        recompileActive_ = true;
-        dispatch_async_f(optimizeQ_, this, optimizeTask);
+        pendingCompiles_++;
+        dispatch_group_async_f(compileJobs_, optimizeQ_, this, optimizeTask);
       }
 
       // wait for the first job to finish.
-      const unsigned msDuration = 1;
-      uint64_t waitIters = 0;
+      auto Deadline = std::chrono::steady_clock::now()
+                    + std::chrono::milliseconds(Cxt_->getCompileTimeout());
       do {
-        if (msDuration * waitIters >= COMPILE_JOB_BAILOUT_MS) {
-          std::cerr << "\n\nERROR: A compile job took too long, aborting!!\n"
-                    << std::flush;
-
-          // we can't cancel any threads or perform cleanup,
-          // so we must forcefully terminate the program.
+        std::unique_lock<std::mutex> Guard(resultAddedLock_);
+        bool Added = resultAdded_.wait_until(Guard, Deadline,
+                                             [this] { return !doneQueueEmpty_; });
+        Guard.unlock();
+
+        if (!Added) {
+          // we can't cancel a compile job that is already running, so
+          // its result will be handed out by a later request instead.
           // See here for discussion: https://github.com/kavon/atJIT/issues/4
-          std::abort();
+          throw CompileJobTimeout(std::get<0>(GMap_));
         }
 
-        // wait a bit
-        sleep_for(msDuration);
-        waitIters++;
-
         // check for a result
         dispatch_sync_f(mutate_recompileDone_, &R, obtainResultTask);
       } while (!R.RetVal.has_value());
@@ -399,14 +532,21 @@ namespace tuner {
 
   // must be dispatched from optimizeQ_.
   // this function will start a chain of recompile jobs
-  // up to the predefined max.
-  // it will then queue a new job that pushes the result
-  // onto the list. Thus, holding the list queue will deadlock
-  // this compile queue!
+  // up to the predefined max. Each job in the chain obtains a batch of
+  // configurations from the tuner, at most as large as the optimization
+  // width of the Context, and applies them to their own copies of the IR.
+  // The pass pipelines of a batch then run concurrently, and each
+  // queues a codegen job that pushes the result onto the list.
+  // Thus, holding the list queue will deadlock this compile queue!
+  //
+  // The job does not wait for its pipelines, since a worker parked here
+  // could be the one needed to run them. Instead, pipelinesDone_callback
+  // is queued on optimizeQ_ once they finish, to carry on with the chain.
   void Optimizer::optimize_callback() {
 #ifndef NDEBUG
     auto Start = std::chrono::system_clock::now();
 #endif
+    uint64_t CPUStart = ExperimentBudget::threadCPUTime();
 
     auto &BT = easy::BitcodeTracker::GetTracker();
 
@@ -417,34 +557,46 @@ namespace tuner {
     easy::Function::WriteOptimizedToFile(*M, Cxt_->getDebugBeforeFile());
 
     /////////////////////
-    // allow the tuner to analyze & modify the IR.
+    // allow the tuner to analyze the IR, and then obtain the batch.
     Tuner_->analyze(*M);
-    auto Gen = Tuner_->getNextConfig();
-    auto TunerConf = Gen.first;
-    auto FB = Gen.second;
+    std::vector<GenResult> Batch = Tuner_->getNextConfigs(Cxt_->getOptimizeWidth());
+
+    // whoever started this job accounted for only one config.
+    pendingCompiles_ += Batch.size() - 1;
+
+    dispatch_group_t Pipelines = dispatch_group_create();
+
+    for (size_t i = 0; i < Batch.size(); i++) {
+      auto TunerConf = Batch[i].first;
+      auto FB = Batch[i].second;
+
+      // every config after the first needs its own copy of the IR.
+      if (i > 0)
+        std::tie(M, LLVMCxt) = BT.getModule(Addr_);
 
-    Tuner_->applyConfig(*TunerConf, *M);
+      Tuner_->applyConfig(*TunerConf, *M);
 
 #ifndef NDEBUG
-    LOG_S(INFO) << "@@ optimize job starting using this config:";
-    dumpConfig(std::cerr, Tuner_->getKnobSet(), *TunerConf);
+      LOG_S(INFO) << "@@ optimize job starting using this config:";
+      dumpConfig(std::cerr, Tuner_->getKnobSet(), *TunerConf);
 
-    Tuner_->dump();
+      Tuner_->dump();
 #endif
 
-    // save the current compilation config to pass it
-    // along to the codegen thread.
-    auto CGLevel = CGOptLvl.getLevel();
-    auto FastISel = FastISelOpt.getFlag();
-    auto IPRA = IPRAOpt.getFlag();
+      // specialize the IR while the knobs still hold this config's values,
+      // and save the rest of the config to pass it along.
+      genSpecializer()->run(*M);
 
-    //////////////////////
+      CompileJob* Job = new CompileJob();
+      Job->M = std::move(M);
+      Job->LLVMCxt = std::move(LLVMCxt);
+      Job->FB = std::move(FB);
+      Job->Opt = this;
+      Job->Opts = snapshotOptions();
 
-    // Optimize the IR.
-    auto MPM = genPassManager();
-    MPM->run(*M);
-
-    easy::Function::WriteOptimizedToFile(*M, Cxt_->getDebugFile(), true);
+      // start an async optimization job
+      dispatch_group_async_f(Pipelines, pipelineQ_, Job, pipelineTask);
+    }
 
 #ifndef NDEBUG
     auto End = std::chrono::system_clock::now();
@@ -452,35 +604,61 @@ namespace tuner {
     LOG_S(INFO) << "@@ optimize job finished in " << elapsed.count() << " ms";
 #endif
 
+    if (Budget_)
+      Budget_->chargeCompile(ExperimentBudget::threadCPUTime() - CPUStart);
+
+    // the width of the batch bounds the number of concurrent pipelines, so
+    // the chain only continues once they are done. Until then, the chain
+    // still counts as a compile job, for the sake of the destructor.
+    dispatch_group_enter(compileJobs_);
+    dispatch_group_notify_f(Pipelines, optimizeQ_, this, pipelinesDoneTask);
+    dispatch_release(Pipelines);
+  }
+
+
+  // must be dispatched from optimizeQ_, once the pipelines
+  // of the batch started by optimize_callback are done.
+  void Optimizer::pipelinesDone_callback() {
     // ask the tuner if we're able to, and *should* try
     // compiling the next config ahead-of-time.
-    bool shouldCompile = Tuner_->shouldCompileNext();
-
-    if (shouldCompile) {
+    if (!stopCompilingAhead_ && Tuner_->shouldCompileNext()
+        && (!Budget_ || Budget_->compileAllowed())) {
       // start an async recompile job
-      dispatch_async_f(optimizeQ_, this, optimizeTask);
+      pendingCompiles_++;
+      dispatch_group_async_f(compileJobs_, optimizeQ_, this, optimizeTask);
     }
 
-    OptimizeResult* OR = new OptimizeResult();
-    OR->M = std::move(M);
-    OR->LLVMCxt = std::move(LLVMCxt);
-    OR->FB = std::move(FB);
-    OR->Opt = this;
-    OR->End = !shouldCompile;
-    OR->CGLevel = CGLevel;
-    OR->FastISel = FastISel;
-    OR->IPRA = IPRA;
+    dispatch_group_leave(compileJobs_);
+  }
+
+
+  // runs the pass pipeline on a specialized module concurrently
+  // with others from the same batch.
+  void Optimizer::pipeline_callback(CompileJob* Job) {
+    uint64_t CPUStart = ExperimentBudget::threadCPUTime();
+
+    auto TM = GetHostTargetMachine();
+    assert(TM);
+
+    // Optimize the IR.
+    auto MPM = genPassManager(Job->Opts, *TM);
+    MPM->run(*(Job->M));
+
+    easy::Function::WriteOptimizedToFile(*(Job->M), Cxt_->getDebugFile(), true);
+
+    if (Budget_)
+      Budget_->chargeCompile(ExperimentBudget::threadCPUTime() - CPUStart);
 
     // start an async codegen job
-    dispatch_async_f(codegenQ_, OR, codegenTask);
+    dispatch_group_async_f(compileJobs_, codegenQ_, Job, codegenTask);
   }
 
 
-
-  void Optimizer::codegen_callback(OptimizeResult* OR) {
+  void Optimizer::codegen_callback(CompileJob* Job) {
 #ifndef NDEBUG
     auto Start = std::chrono::system_clock::now();
 #endif
+    uint64_t CPUStart = ExperimentBudget::threadCPUTime();
 
     const char* Name;
     easy::GlobalMapping* Globals;
@@ -489,12 +667,19 @@ namespace tuner {
     // Compile to assembly.
     std::unique_ptr<easy::Function> Fun =
         easy::Function::CompileAndWrap(
-            Name, Globals, std::move(OR->LLVMCxt), std::move(OR->M), OR->CGLevel,
-            OR->FastISel, OR->IPRA);
+            Name, Globals, std::move(Job->LLVMCxt), std::move(Job->M), Job->Opts.CGLevel,
+            Job->Opts.FastISel, Job->Opts.IPRA, Cxt_->getObjectCacheDir());
+
+    // the version has already handed its pooled context back, so only its
+    // machine code and a bitcode copy of its IR remain.
+
+    // charged before the result is handed out, so that the driver sees it.
+    if (Budget_)
+      Budget_->chargeCompile(ExperimentBudget::threadCPUTime() - CPUStart);
 
     AddCompileResult ACR;
     ACR.Opt = this;
-    ACR.Result = {std::move(Fun), std::move(OR->FB)};
+    ACR.Result = {std::move(Fun), std::move(Job->FB)};
 
     dispatch_sync_f(mutate_recompileDone_, &ACR, addResultTask);
 
@@ -504,9 +689,8 @@ namespace tuner {
     LOG_S(INFO) << "$$ codegen job finished in " << elapsed.count() << " ms";
 #endif
 
-    // am I the end of the chain?
-    if (OR->End)
-      recompileActive_ = false;
+    // this compile is finished now that its result is on the list.
+    pendingCompiles_--;
   }
 
 
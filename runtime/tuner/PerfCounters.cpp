@@ -0,0 +1,145 @@
+#include <tuner/PerfCounters.h>
+
+#include <memory>
+#include <mutex>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace tuner {
+
+namespace {
+#ifdef __linux__
+  struct EventConfig {
+    uint32_t Type;
+    uint64_t Config;
+  };
+
+  const EventConfig Events[PC_NumCounters] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                          | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+  };
+
+  // counts user-space events of the calling thread, on any CPU, as a
+  // member of the group led by Leader, or as a new leader if it is -1.
+  int openEvent(EventConfig const& E, int Leader) {
+    perf_event_attr Attr = {};
+    Attr.size = sizeof(Attr);
+    Attr.type = E.Type;
+    Attr.config = E.Config;
+    Attr.exclude_kernel = 1;
+    Attr.exclude_hv = 1;
+    Attr.read_format = PERF_FORMAT_GROUP
+                       | PERF_FORMAT_TOTAL_TIME_ENABLED
+                       | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return syscall(SYS_perf_event_open, &Attr, 0, -1, Leader, 0);
+  }
+#endif
+} // end anonymous namespace
+
+PerfCounters::PerfCounters() {
+  for (unsigned i = 0; i < PC_NumCounters; i++) {
+    Fds_[i] = -1;
+#ifdef __linux__
+    Pages_[i] = nullptr;
+#endif
+  }
+
+#ifdef __linux__
+  static_assert(PC_Cycles == 0, "the cycle counter leads the group");
+
+  for (unsigned i = 0; i < PC_NumCounters; i++) {
+    // without a leader, there is no group to join.
+    if (i != PC_Cycles && Fds_[PC_Cycles] < 0)
+      break;
+
+    Fds_[i] = openEvent(Events[i], i == PC_Cycles ? -1 : Fds_[PC_Cycles]);
+    if (Fds_[i] < 0)
+      continue;
+
+    Order_[NumOpen_++] = i;
+
+    // without the page, the counter is still read through its descriptor.
+    void *Page = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, Fds_[i], 0);
+    if (Page != MAP_FAILED)
+      Pages_[i] = static_cast<perf_event_mmap_page*>(Page);
+  }
+
+  // a group is only ever scheduled as a whole, so if there are not enough
+  // counters free for all of it, it never counts anything.
+  if (NumOpen_ > 1) {
+    Reading R;
+    readGroup(R);
+    if (R.Enabled > 0 && R.Running == 0)
+      closeMembers();
+  }
+#endif
+}
+
+void PerfCounters::closeMembers() {
+#ifdef __linux__
+  for (unsigned i = 0; i < PC_NumCounters; i++) {
+    if (i == PC_Cycles)
+      continue;
+    if (Pages_[i])
+      munmap((void*) Pages_[i], sysconf(_SC_PAGESIZE));
+    if (Fds_[i] >= 0)
+      close(Fds_[i]);
+    Pages_[i] = nullptr;
+    Fds_[i] = -1;
+  }
+  NumOpen_ = Fds_[PC_Cycles] >= 0 ? 1 : 0;
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+  closeMembers();
+#ifdef __linux__
+  if (Pages_[PC_Cycles])
+    munmap((void*) Pages_[PC_Cycles], sysconf(_SC_PAGESIZE));
+  if (Fds_[PC_Cycles] >= 0)
+    close(Fds_[PC_Cycles]);
+#endif
+}
+
+void PerfCounters::readGroup(Reading &R) const {
+#ifdef __linux__
+  // { nr, time_enabled, time_running, value of each member, leader first }
+  uint64_t Buf[3 + PC_NumCounters];
+  ssize_t Size = sizeof(uint64_t) * (3 + NumOpen_);
+  if (NumOpen_ == 0 || ::read(Fds_[PC_Cycles], Buf, Size) != Size)
+    return;
+
+  R.Enabled = Buf[1];
+  R.Running = Buf[2];
+  for (unsigned k = 0; k < Buf[0] && k < NumOpen_; k++)
+    R.Counts[Order_[k]] = Buf[3 + k];
+#endif
+}
+
+PerfCounters* PerfCounters::forThread() {
+  thread_local std::unique_ptr<PerfCounters> Counters = [] {
+    auto PC = std::make_unique<PerfCounters>();
+    if (!PC->available(PC_Cycles))
+      PC.reset();
+    return PC;
+  }();
+  return Counters.get();
+}
+
+bool PerfCounters::supported() {
+  static bool Supported = (forThread() != nullptr);
+  return Supported;
+}
+
+} // end namespace
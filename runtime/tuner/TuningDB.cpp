@@ -0,0 +1,208 @@
+#include <tuner/TuningDB.h>
+#include <tuner/param.h>
+
+#include <llvm/Support/Host.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace tuner {
+
+namespace {
+  const char* FileHeader = "# atJIT tuning database";
+
+  std::vector<std::string> split(std::string const& Str, char Sep) {
+    std::vector<std::string> Parts;
+    std::stringstream SS(Str);
+    std::string Part;
+    while (std::getline(SS, Part, Sep))
+      Parts.push_back(Part);
+    return Parts;
+  }
+
+  template<typename T>
+  void printSetting(std::ostream &OS, std::optional<T> const& Opt) {
+    if (Opt)
+      OS << (int) Opt.value();
+    else
+      OS << "-";
+  }
+
+  template<typename T>
+  void parseSetting(std::string const& Str, std::optional<T> &Opt) {
+    if (Str == "-")
+      Opt = std::nullopt;
+    else
+      Opt = (T) std::stoi(Str);
+  }
+
+  void printLoopSetting(std::ostream &OS, LoopSetting const& LS) {
+    printSetting(OS, LS.VectorizeWidth); OS << ",";
+    printSetting(OS, LS.InterleaveCount); OS << ",";
+    printSetting(OS, LS.UnrollDisable); OS << ",";
+    printSetting(OS, LS.UnrollFull); OS << ",";
+    printSetting(OS, LS.UnrollCount); OS << ",";
+    printSetting(OS, LS.LICMVerDisable); OS << ",";
+    printSetting(OS, LS.Distribute); OS << ",";
+    printSetting(OS, LS.Section);
+  }
+
+  std::optional<LoopSetting> parseLoopSetting(std::string const& Str) {
+    auto Parts = split(Str, ',');
+    if (Parts.size() != 8)
+      return std::nullopt;
+
+    LoopSetting LS;
+    parseSetting(Parts[0], LS.VectorizeWidth);
+    parseSetting(Parts[1], LS.InterleaveCount);
+    parseSetting(Parts[2], LS.UnrollDisable);
+    parseSetting(Parts[3], LS.UnrollFull);
+    parseSetting(Parts[4], LS.UnrollCount);
+    parseSetting(Parts[5], LS.LICMVerDisable);
+    parseSetting(Parts[6], LS.Distribute);
+    parseSetting(Parts[7], LS.Section);
+    return LS;
+  }
+
+  std::optional<std::pair<std::string, TuningRecord>> parseRecord(std::string const& Line) {
+    auto Fields = split(Line, '\t');
+    if (Fields.size() < 2)
+      return std::nullopt;
+
+    TuningRecord Rec;
+    Rec.ExpectedValue = std::strtod(Fields[1].c_str(), nullptr);
+
+    for (size_t i = 2; i < Fields.size(); i++) {
+      auto Eq = Fields[i].rfind('=');
+      if (Eq == std::string::npos)
+        return std::nullopt;
+
+      std::string Name = Fields[i].substr(0, Eq);
+      std::string Val = Fields[i].substr(Eq+1);
+
+      if (Val.find(',') != std::string::npos) {
+        auto LS = parseLoopSetting(Val);
+        if (!LS)
+          return std::nullopt;
+        Rec.LoopConfig[Name] = LS.value();
+      } else {
+        Rec.IntConfig[Name] = std::stoi(Val);
+      }
+    }
+
+    return std::make_pair(Fields[0], Rec);
+  }
+} // end anonymous namespace
+
+  TuningDB::TuningDB(std::string Path) : Path_(std::move(Path)) {
+    std::ifstream File(Path_);
+    std::string Line;
+
+    while (std::getline(File, Line)) {
+      if (Line.empty() || Line[0] == '#')
+        continue;
+
+      // a damaged record is dropped rather than trusted.
+      try {
+        auto Rec = parseRecord(Line);
+        if (Rec)
+          Records_[Rec->first] = Rec->second;
+      } catch (std::logic_error const&) {}
+    }
+  }
+
+  std::optional<TuningRecord> TuningDB::lookup(std::string const& Key) const {
+    std::lock_guard<std::mutex> Guard(Lock_);
+    auto Found = Records_.find(Key);
+    if (Found == Records_.end())
+      return std::nullopt;
+    return Found->second;
+  }
+
+  void TuningDB::update(std::string const& Key, TuningRecord Rec) {
+    std::lock_guard<std::mutex> Guard(Lock_);
+    Records_[Key] = std::move(Rec);
+  }
+
+  void TuningDB::save() const {
+    std::lock_guard<std::mutex> Guard(Lock_);
+
+    // write to a temporary file first, so that a crash while saving
+    // does not destroy the prior results.
+    std::string TmpPath = Path_ + ".tmp";
+    std::ofstream File(TmpPath, std::ios::out | std::ios::trunc);
+    if (!File)
+      return;
+
+    File << FileHeader << "\n";
+    File << std::hexfloat;
+
+    for (auto const& Entry : Records_) {
+      TuningRecord const& Rec = Entry.second;
+      File << Entry.first << "\t" << Rec.ExpectedValue;
+
+      for (auto const& Int : Rec.IntConfig)
+        File << "\t" << Int.first << "=" << Int.second;
+
+      for (auto const& Loop : Rec.LoopConfig) {
+        File << "\t" << Loop.first << "=";
+        printLoopSetting(File, Loop.second);
+      }
+
+      File << "\n";
+    }
+
+    File.close();
+    if (!File.fail())
+      std::rename(TmpPath.c_str(), Path_.c_str());
+  }
+
+  std::string TuningDB::makeKey(std::string const& FunName, easy::Context const& Cxt) {
+    std::stringstream Key;
+    Key << FunName << ";" << llvm::sys::getHostCPUName().str() << ";";
+
+    for (auto const& AB : Cxt) {
+      switch(AB->kind()) {
+        case easy::ArgumentBase::AK_Forward:
+          Key << "_" << AB->as<easy::ForwardArgument>()->get();
+          break;
+
+        case easy::ArgumentBase::AK_Int:
+          Key << "i" << AB->as<easy::IntArgument>()->get();
+          break;
+
+        case easy::ArgumentBase::AK_Float:
+          Key << "f" << std::hexfloat << AB->as<easy::FloatArgument>()->get()
+              << std::defaultfloat;
+          break;
+
+        case easy::ArgumentBase::AK_Ptr:
+          Key << "p";
+          break;
+
+        case easy::ArgumentBase::AK_Struct: {
+          Key << "s" << std::hex;
+          for (char C : AB->as<easy::StructArgument>()->get())
+            Key << std::setw(2) << std::setfill('0') << (unsigned) (unsigned char) C;
+          Key << std::dec;
+        } break;
+
+        case easy::ArgumentBase::AK_Module:
+          Key << "m";
+          break;
+
+        case easy::ArgumentBase::AK_IntRange: {
+          auto *Range = AB->as<easy::IntRangeArgument>()->get();
+          Key << "r" << Range->min() << ":" << Range->max();
+        } break;
+      };
+      Key << ",";
+    }
+
+    return Key.str();
+  }
+
+} // end namespace
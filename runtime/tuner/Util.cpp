@@ -3,6 +3,8 @@
 #include <tuner/JSON.h>
 
 #include <chrono>
+#include <mutex>
+#include <set>
 #include <thread>
 
 namespace tuner {
@@ -24,6 +26,47 @@ void sleep_for(unsigned ms) {
   std::this_thread::sleep_for(std::chrono::milliseconds(ms));
 }
 
+namespace {
+  // never destroyed, since threads may exit after static destructors run.
+  struct ThreadIndices {
+    std::mutex Lock;
+    std::set<unsigned> Free;
+    unsigned Next = 0;
+  };
+
+  ThreadIndices& getIndices() {
+    static ThreadIndices *Indices = new ThreadIndices();
+    return *Indices;
+  }
+
+  struct ThreadIndex {
+    unsigned Idx;
+
+    // hand out the lowest free index, to keep them small.
+    ThreadIndex() {
+      auto &TI = getIndices();
+      std::lock_guard<std::mutex> Guard(TI.Lock);
+      if (TI.Free.empty()) {
+        Idx = TI.Next++;
+      } else {
+        Idx = *TI.Free.begin();
+        TI.Free.erase(TI.Free.begin());
+      }
+    }
+
+    ~ThreadIndex() {
+      auto &TI = getIndices();
+      std::lock_guard<std::mutex> Guard(TI.Lock);
+      TI.Free.insert(Idx);
+    }
+  };
+} // end anonymous namespace
+
+unsigned threadIndex() {
+  thread_local ThreadIndex Current;
+  return Current.Idx;
+}
+
 } // end namespace
 
 int JSON::depth = 0;
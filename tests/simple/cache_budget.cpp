@@ -0,0 +1,38 @@
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <easy/code_cache.h>
+
+#include <functional>
+#include <cstdio>
+
+using namespace std::placeholders;
+
+int add (int a, int b) {
+  return a+b;
+}
+
+int main() {
+  easy::Cache<> C;
+  C.setMaxEntries(2);
+
+  C.jit(add, _1, 1);
+  C.jit(add, _1, 2);
+
+  // using add(_, 1) again makes add(_, 2) the least recently used.
+  C.jit(add, _1, 1);
+  auto const &add3 = C.jit(add, _1, 3);
+
+  // CHECK: size 2, evictions 1
+  printf("size %zu, evictions %zu\n", C.size(), C.evictions());
+
+  // CHECK: has 1: 1, has 2: 0, has 3: 1
+  printf("has 1: %d, has 2: %d, has 3: %d\n",
+         C.has(add, _1, 1), C.has(add, _1, 2), C.has(add, _1, 3));
+
+  // CHECK: add3(4) is 7
+  printf("add3(%d) is %d\n", 4, add3(4));
+
+  return 0;
+}
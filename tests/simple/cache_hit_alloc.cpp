@@ -0,0 +1,55 @@
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <easy/code_cache.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+
+// looking up a function that is already in a cache only builds the key of
+// its context, which must not allocate anything.
+
+using namespace std::placeholders;
+
+static std::atomic<size_t> Allocations{0};
+
+void* operator new(size_t Size) {
+  Allocations++;
+  if(void* Ptr = std::malloc(Size ? Size : 1))
+    return Ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* Ptr) noexcept {
+  std::free(Ptr);
+}
+
+void operator delete(void* Ptr, size_t) noexcept {
+  std::free(Ptr);
+}
+
+int add (int a, int b, int c) {
+  return a+b+c;
+}
+
+int main() {
+  easy::Cache<> C;
+  easy::ConcurrentCache<> CC;
+
+  int Sum = C.jit(add, _1, 1, 2)(3) + CC.jit(add, _1, 1, 2)(3);
+
+  size_t Before = Allocations;
+  for(int i = 0; i != 100; ++i) {
+    C.jit(add, _1, 1, 2);
+    CC.jit(add, _1, 1, 2);
+  }
+
+  // CHECK: sum is 12, allocations on hits: 0
+  printf("sum is %d, allocations on hits: %zu\n", Sum, Allocations - Before);
+
+  return 0;
+}
@@ -0,0 +1,48 @@
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+// UNSUPPORTED: orcjit
+
+#include <easy/jit.h>
+
+#include <functional>
+#include <cstdio>
+#include <sstream>
+#include <string>
+
+// the IR of a code-only version is released after codegen. It must still
+// be possible to compose it into another function and to serialize it.
+
+using namespace std::placeholders;
+using namespace easy::options;
+
+int add (int a, int b) {
+  return a+b;
+}
+
+int apply (int (*f)(int), int x) {
+  return f(x);
+}
+
+int main() {
+  auto inc = easy::jit(add, _1, 1, code_only(true));
+
+  // CHECK: inc(4) is 5
+  printf("inc(%d) is %d\n", 4, inc(4));
+
+  auto apply_inc = easy::jit(apply, inc, _1);
+
+  // CHECK: apply_inc(5) is 6
+  printf("apply_inc(%d) is %d\n", 5, apply_inc(5));
+
+  std::stringstream out;
+  inc.serialize(out);
+
+  std::stringstream in(out.str());
+  auto inc_load = easy::FunctionWrapper<int(int)>::deserialize(in);
+
+  // CHECK: inc_load(6) is 7
+  printf("inc_load(%d) is %d\n", 6, inc_load(6));
+
+  return 0;
+}
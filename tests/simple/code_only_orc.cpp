@@ -0,0 +1,36 @@
+// REQUIRES: orcjit
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <easy/jit.h>
+#include <tuner/optimizer.h>
+
+#include <functional>
+#include <cstdio>
+
+// the ORC session never frees the code of a version, so asking for a
+// code-only version must fail rather than quietly keep the code around.
+
+using namespace std::placeholders;
+using namespace easy::options;
+
+int add (int a, int b) {
+  return a+b;
+}
+
+int main() {
+  try {
+    auto inc = easy::jit(add, _1, 1, code_only(true));
+    printf("inc(%d) is %d\n", 4, inc(4));
+  } catch(tuner::CodeOnlyUnsupported const &E) {
+    // CHECK: rejected: code_only cannot free the code of versions in an ORC session, for: {{.*}}add
+    printf("rejected: %s\n", E.what());
+  }
+
+  // CHECK: inc(5) is 6
+  auto inc = easy::jit(add, _1, 1);
+  printf("inc(%d) is %d\n", 5, inc(5));
+
+  return 0;
+}
@@ -0,0 +1,58 @@
+// RUN: %atjitc -lpthread %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <easy/code_cache.h>
+
+#include <functional>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// all threads ask for the same functions at the same time. Each key must be
+// compiled only once, so every thread must get back the same version.
+
+using namespace std::placeholders;
+
+int add (int a, int b) {
+  return a+b;
+}
+
+int main() {
+  const int THREADS = 4;
+
+  easy::ConcurrentCache<> C;
+  std::vector<void const*> Seen(THREADS);
+  std::vector<int> Inc(THREADS), AddT(THREADS);
+
+  std::vector<std::thread> Workers;
+  for(int t = 0; t != THREADS; ++t) {
+    Workers.emplace_back([&, t]() {
+      for(int i = 0; i != 100; ++i) {
+        auto const &inc = C.jit(add, _1, 1);
+        auto const &add_t = C.jit(add, _1, t);
+
+        Seen[t] = &inc;
+        Inc[t] = inc(i);
+        AddT[t] = add_t(i);
+      }
+    });
+  }
+
+  for(auto &W : Workers)
+    W.join();
+
+  // CHECK: thread 0: inc(99) is 100, add(99, 0) is 99, same inc: 1
+  // CHECK: thread 1: inc(99) is 100, add(99, 1) is 100, same inc: 1
+  // CHECK: thread 2: inc(99) is 100, add(99, 2) is 101, same inc: 1
+  // CHECK: thread 3: inc(99) is 100, add(99, 3) is 102, same inc: 1
+  for(int t = 0; t != THREADS; ++t)
+    printf("thread %d: inc(99) is %d, add(99, %d) is %d, same inc: %d\n",
+           t, Inc[t], t, AddT[t], Seen[t] == Seen[0]);
+
+  // add(_1, 1) is shared by inc and the second thread.
+  // CHECK: entries: 4
+  printf("entries: %zu\n", C.size());
+
+  return 0;
+}
@@ -0,0 +1,50 @@
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <easy/code_cache.h>
+
+#include <functional>
+#include <cstdio>
+
+// contexts whose arguments only differ by their order, or by the order of
+// the bytes of a struct, must get different entries in the cache. So must
+// contexts that only differ by their options.
+
+using namespace std::placeholders;
+using namespace easy::options;
+
+struct Point {
+  int x;
+  int y;
+};
+
+int sub (int a, int b) {
+  return a-b;
+}
+
+int dist (Point a, Point b) {
+  return (a.x-b.x)*10 + (a.y-b.y);
+}
+
+int main() {
+  easy::Cache<> C;
+
+  for(int i = 0; i != 4; ++i) {
+    auto const &ab = C.jit(sub, 1, 2);
+    auto const &ba = C.jit(sub, 2, 1);
+    auto const &p = C.jit(dist, Point{1,2}, _1);
+    auto const &q = C.jit(dist, Point{2,1}, _1);
+    auto const &ab2 = C.jit(sub, 1, 2, retained_versions(2));
+
+    // CHECK: sub(1,2) is -1, sub(2,1) is 1, with options: -1
+    // CHECK: dist(1:2) is 12, dist(2:1) is 21
+    printf("sub(1,2) is %d, sub(2,1) is %d, with options: %d\n", ab(), ba(), ab2());
+    printf("dist(1:2) is %d, dist(2:1) is %d\n", p(Point{0,0}), q(Point{0,0}));
+  }
+
+  // CHECK: entries: 5
+  printf("entries: %zu\n", C.size());
+
+  return 0;
+}
@@ -0,0 +1,42 @@
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <easy/jit_async.h>
+
+#include <functional>
+#include <cstdio>
+
+// calls give the right answer both before and after the
+// specialized version takes over.
+
+using namespace std::placeholders;
+
+int sub (int a, int b) {
+  return a-b;
+}
+
+int main() {
+  auto minus3 = easy::jit_async(sub, _1, 3);
+
+  // CHECK: before: minus3(10) is 7
+  printf("before: minus3(%d) is %d\n", 10, minus3(10));
+
+  minus3.wait();
+
+  // CHECK: ready: 1
+  // CHECK: after: minus3(10) is 7
+  printf("ready: %d\n", minus3.ready());
+  printf("after: minus3(%d) is %d\n", 10, minus3(10));
+
+  // placeholders may be reordered, just like with easy::jit.
+  auto rsub = easy::jit_async(sub, _2, _1);
+
+  // CHECK: rsub(1, 5) is 4
+  printf("rsub(%d, %d) is %d\n", 1, 5, rsub(1, 5));
+  rsub.wait();
+  // CHECK: rsub(1, 5) is 4
+  printf("rsub(%d, %d) is %d\n", 1, 5, rsub(1, 5));
+
+  return 0;
+}
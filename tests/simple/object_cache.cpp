@@ -0,0 +1,42 @@
+// RUN: %atjitc   %s -o %t
+// RUN: rm -rf %t.cache
+// RUN: %t %t.cache > %t.out
+// RUN: %FileCheck %s --check-prefixes=CHECK,COLD < %t.out
+// RUN: ls %t.cache | %FileCheck %s --check-prefix=CACHED
+// RUN: %t %t.cache > %t.warm.out
+// RUN: %FileCheck %s --check-prefixes=CHECK,WARM < %t.warm.out
+
+#include <easy/jit.h>
+#include <easy/runtime/ObjectCache.h>
+
+#include <functional>
+#include <cstdio>
+
+using namespace std::placeholders;
+
+int add (int a, int b) {
+  return a+b;
+}
+
+int main(int argc, char** argv) {
+
+  // the second run loads the object compiled by the first.
+  easy::FunctionWrapper<int(int)> inc = easy::jit(add, _1, 1, easy::options::object_cache(argv[1]));
+
+  // CACHED: .o
+
+  // CHECK: inc(4) is 5
+  // CHECK: inc(5) is 6
+  // CHECK: inc(6) is 7
+  // CHECK: inc(7) is 8
+  for(int v = 4; v != 8; ++v)
+    printf("inc(%d) is %d\n", v, inc(v));
+
+  // COLD: hits: 0, misses: 1
+  // WARM: hits: 1, misses: 0
+  printf("hits: %lu, misses: %lu\n",
+         (unsigned long) easy::DiskObjectCache::hits(),
+         (unsigned long) easy::DiskObjectCache::misses());
+
+  return 0;
+}
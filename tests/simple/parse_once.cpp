@@ -0,0 +1,36 @@
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <easy/jit.h>
+#include <easy/runtime/BitcodeTracker.h>
+
+#include <functional>
+#include <cstdio>
+#include <vector>
+
+// every compile of a function after the first clones its module from the
+// master kept in a pooled context, even while the versions compiled
+// before are all still alive.
+
+using namespace std::placeholders;
+
+int add (int a, int b) {
+  return a+b;
+}
+
+int main() {
+  const int TRIALS = 8;
+
+  std::vector<easy::FunctionWrapper<int(int)>> Versions;
+  for(int k = 0; k != TRIALS; ++k)
+    Versions.emplace_back(easy::jit(add, _1, k));
+
+  // CHECK: add(1, 7) is 8
+  printf("add(1, %d) is %d\n", TRIALS-1, Versions.back()(1));
+
+  // CHECK: parses: 1
+  printf("parses: %lu\n", (unsigned long) easy::BitcodeTracker::parses());
+
+  return 0;
+}
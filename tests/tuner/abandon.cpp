@@ -0,0 +1,60 @@
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <tuner/driver.h>
+#include <tuner/param.h>
+
+#include <algorithm>
+#include <functional>
+#include <cstdio>
+
+// every config but the default is a thousand times slower, and its times
+// alternate between two values an order of magnitude apart. So, a trial of
+// a slow config needs about 70 calls to reach good statistics, but must be
+// abandoned long before that, since it is clearly worse than the best.
+
+using namespace std::placeholders;
+using namespace tuned_param;
+using namespace easy::options;
+
+int spin(int n, int k) {
+  int iters = k == 1 ? 100 : 100 * 1000 * (n % 2 ? 10 : 1);
+  volatile int sum = 0;
+  for (int i = 0; i < iters; i++)
+    sum += i;
+  return k;
+}
+
+int main(int argc, char** argv) {
+
+  tuner::ATDriver AT;
+
+  void const* Slow = nullptr;
+  int Run = 0, LongestRun = 0;
+
+  for (int i = 0; i < 1000; i++) {
+    auto const &F = AT.reoptimize(spin, _1, IntRange(1, 4, 1),
+                      tuner_kind(tuner::AT_Random),
+                      feedback_kind(tuner::FB_Total),
+                      blocking(true));
+
+    if (F(i) == 1) {
+      Slow = nullptr;
+      continue;
+    }
+
+    // the calls served by this trial of a slow config so far.
+    Run = (&F == Slow) ? Run + 1 : 1;
+    Slow = &F;
+    LongestRun = std::max(LongestRun, Run);
+  }
+
+  // CHECK: longest slow trial: {{[1-9]|[1-3][0-9]}} calls
+  printf("longest slow trial: %d calls\n", LongestRun);
+
+  // CHECK: "abandoned" : {{[1-9][0-9]*}}
+  AT.exportStats(std::cout);
+
+  return 0;
+}
@@ -0,0 +1,39 @@
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <tuner/driver.h>
+#include <tuner/param.h>
+
+#include <functional>
+#include <cstdio>
+
+using namespace std::placeholders;
+using namespace tuned_param;
+using namespace easy::options;
+
+int add(int a, int b) {
+  return a + b;
+}
+
+int main(int argc, char** argv) {
+
+  tuner::ATDriver AT;
+
+  auto inc = AT.bind(add, _1, 1, tuner_kind(tuner::AT_Random));
+
+  int sum = 0;
+  for (int i = 0; i < 100; i++)
+    sum += inc(i);
+
+  // CHECK: sum is 5050
+  printf("sum is %d\n", sum);
+
+  // the handle and reoptimize share the same tuning state.
+  auto const& incAgain = AT.reoptimize(add, _1, 1, tuner_kind(tuner::AT_Random));
+
+  // CHECK: inc(4) is 5
+  printf("inc(%d) is %d\n", 4, incAgain(4));
+
+  return 0;
+}
@@ -0,0 +1,38 @@
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <tuner/driver.h>
+
+#include <functional>
+#include <cstdio>
+
+// without a tuner, the first version is final, so calls through the handle
+// after the first one go straight to it, without asking the driver.
+
+using namespace std::placeholders;
+using namespace easy::options;
+
+int add(int a, int b) {
+  return a + b;
+}
+
+int main(int argc, char** argv) {
+
+  tuner::ATDriver AT;
+
+  auto inc = AT.bind(add, _1, 1, tuner_kind(tuner::AT_None));
+
+  int sum = 0;
+  for (int i = 0; i < 100; i++)
+    sum += inc(i);
+
+  // CHECK: sum is 5050
+  printf("sum is %d\n", sum);
+
+  // only the first call, which compiled the version, was a request.
+  // CHECK: "requests" : 1
+  AT.exportStats(std::cout);
+
+  return 0;
+}
@@ -0,0 +1,79 @@
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <tuner/driver.h>
+#include <tuner/param.h>
+
+#include <functional>
+#include <cstdio>
+
+// with no budget for experiments, the driver must keep serving the first
+// version, which uses the default config, whereas without a budget it
+// experiments with other configs right away.
+
+using namespace std::placeholders;
+using namespace tuned_param;
+using namespace easy::options;
+
+int scale(int a, int b) {
+  return a * b;
+}
+
+void run(tuner::ATDriver &AT) {
+  bool Served[9] = {};
+
+  for (int i = 0; i < 200; i++) {
+    auto const &F = AT.reoptimize(scale, _1, IntRange(1, 8, 4),
+                      tuner_kind(tuner::AT_Random),
+                      feedback_kind(tuner::FB_Total_IgnoreError),
+                      blocking(true));
+
+    int b = F(1);
+    if (b >= 1 && b <= 8)
+      Served[b] = true;
+  }
+
+  printf("served:");
+  for (int b = 1; b <= 8; b++)
+    if (Served[b])
+      printf(" %d", b);
+  printf("\n");
+}
+
+int main(int argc, char** argv) {
+
+  // CHECK: no trial budget
+  // CHECK-NEXT: served: 4{{$}}
+  // CHECK: "experiments" : 0
+  {
+    printf("no trial budget\n");
+    tuner::ATDriver AT;
+    AT.setTrialBudget(0);
+    run(AT);
+    AT.exportStats(std::cout);
+    printf("\n");
+  }
+
+  // CHECK: no compile budget
+  // CHECK-NEXT: served: 4{{$}}
+  {
+    printf("no compile budget\n");
+    tuner::ATDriver AT;
+    AT.setCompileBudget(0);
+    run(AT);
+  }
+
+  // CHECK: unlimited
+  // CHECK-NEXT: served: {{.*[0-9] [0-9].*}}
+  {
+    printf("unlimited\n");
+    tuner::ATDriver AT;
+    run(AT);
+
+    // CHECK: compile time: {{[1-9][0-9]*}} ns
+    printf("compile time: %lu ns\n", (unsigned long) AT.compileTime());
+  }
+
+  return 0;
+}
@@ -0,0 +1,34 @@
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <tuner/Clock.h>
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+// the clock used for feedback must agree with steady_clock, whether or
+// not it reads the time stamp counter.
+
+int main(int argc, char** argv) {
+  using namespace std::chrono;
+
+  auto Start = tuner::Clock::start();
+  auto SteadyStart = steady_clock::now();
+  std::this_thread::sleep_for(milliseconds(20));
+  auto SteadyEnd = steady_clock::now();
+  auto End = tuner::Clock::stop();
+
+  double Elapsed = duration_cast<nanoseconds>(End - Start).count();
+  double SteadyElapsed = duration_cast<nanoseconds>(SteadyEnd - SteadyStart).count();
+
+  // CHECK: agrees: 1
+  printf("agrees: %d\n", Elapsed >= SteadyElapsed && Elapsed < 1.1 * SteadyElapsed);
+
+  // CHECK: same timeline: 1
+  auto Offset = tuner::Clock::now().time_since_epoch() - steady_clock::now().time_since_epoch();
+  printf("same timeline: %d\n", std::abs(duration_cast<milliseconds>(Offset).count()) < 10);
+
+  return 0;
+}
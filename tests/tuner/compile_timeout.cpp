@@ -0,0 +1,45 @@
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <tuner/driver.h>
+
+#include <functional>
+#include <cstdio>
+#include <thread>
+#include <chrono>
+
+// a compile job can't finish in zero milliseconds, so the first request
+// must time out. the job keeps running though, and its result is handed
+// out by a later request.
+
+using namespace std::placeholders;
+using namespace easy::options;
+
+int add(int a, int b) {
+  return a + b;
+}
+
+int main(int argc, char** argv) {
+
+  tuner::ATDriver AT;
+
+  bool TimedOut = false;
+  while (true) {
+    try {
+      auto const& inc = AT.reoptimize(add, _1, 1, compile_timeout(0));
+
+      // CHECK: timed out: 1
+      // CHECK: inc(4) is 5
+      printf("timed out: %d\n", TimedOut);
+      printf("inc(%d) is %d\n", 4, inc(4));
+      break;
+
+    } catch (tuner::CompileJobTimeout const &) {
+      TimedOut = true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,60 @@
+// RUN: %atjitc -lpthread %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <tuner/driver.h>
+#include <tuner/param.h>
+
+#include <functional>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// several threads hammer the same ATDriver, both on a shared
+// function + context and on a per-thread one, while it tunes them.
+
+using namespace std::placeholders;
+using namespace tuned_param;
+using namespace easy::options;
+
+int scale(int a, int b) {
+  return a * b;
+}
+
+int main(int argc, char** argv) {
+
+  const int THREADS = 4;
+  const int ITERS = 200;
+
+  tuner::ATDriver AT;
+  std::vector<int> Shared(THREADS), Mine(THREADS);
+
+  std::vector<std::thread> Workers;
+  for (int t = 0; t < THREADS; t++) {
+    Workers.emplace_back([&, t]() {
+      for (int i = 0; i < ITERS; i++) {
+        // a version is only used until the thread's next reoptimize.
+        Shared[t] = AT.reoptimize(scale, _1, 3,
+                        tuner_kind(tuner::AT_Random),
+                        blocking(false))(i);
+
+        Mine[t] = AT.reoptimize(scale, _1, t + 10,
+                      tuner_kind(tuner::AT_Random),
+                      blocking(false))(i);
+      }
+    });
+  }
+
+  for (auto &W : Workers)
+    W.join();
+
+  // CHECK: thread 0: scale(199, 3) is 597, scale(199, 10) is 1990
+  // CHECK: thread 1: scale(199, 3) is 597, scale(199, 11) is 2189
+  // CHECK: thread 2: scale(199, 3) is 597, scale(199, 12) is 2388
+  // CHECK: thread 3: scale(199, 3) is 597, scale(199, 13) is 2587
+  for (int t = 0; t < THREADS; t++)
+    printf("thread %d: scale(%d, 3) is %d, scale(%d, %d) is %d\n",
+           t, ITERS - 1, Shared[t], ITERS - 1, t + 10, Mine[t]);
+
+  return 0;
+}
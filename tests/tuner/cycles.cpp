@@ -0,0 +1,64 @@
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <tuner/driver.h>
+#include <tuner/param.h>
+
+#include <functional>
+#include <cstdio>
+
+// cycle-count feedback must tell a version that does four times the work
+// from one that does not, whether or not the hardware counters can be
+// opened, falling back to wall time when they cannot.
+
+using namespace std::placeholders;
+using namespace tuned_param;
+using namespace easy::options;
+
+int sum(int n, int k) {
+  volatile int s = 0;
+  for (int i = 0; i < n; i++)
+    s = s + k;
+  return s;
+}
+
+int main(int argc, char** argv) {
+
+  const int CALLS = 200;
+
+  tuner::ATDriver AT;
+  auto const &Small = AT.reoptimize(sum, 1000, IntRange(1, 4, 2),
+                          tuner_kind(tuner::AT_Random),
+                          feedback_kind(tuner::FB_Cycles),
+                          blocking(true));
+
+  auto const &Large = AT.reoptimize(sum, 4000, IntRange(1, 4, 2),
+                          tuner_kind(tuner::AT_Random),
+                          feedback_kind(tuner::FB_Cycles),
+                          blocking(true));
+
+  for (int i = 0; i < CALLS; i++) {
+    Small();
+    Large();
+  }
+
+  auto &SmallFB = Small.getFeedback();
+  auto &LargeFB = Large.getFeedback();
+  SmallFB.updateStats();
+  LargeFB.updateStats();
+
+  // CHECK: small is better: 1
+  // CHECK: large is better: 0
+  // CHECK: large costs over twice as much: 1
+  printf("small is better: %d\n", SmallFB.betterThan(LargeFB));
+  printf("large is better: %d\n", LargeFB.betterThan(SmallFB));
+  printf("large costs over twice as much: %d\n",
+         LargeFB.expectedValue() > 2 * SmallFB.expectedValue());
+
+  // CHECK: "kind" : "cycles"
+  // CHECK: "unit" : "{{cycles|nano}}"
+  AT.exportStats(std::cout);
+
+  return 0;
+}
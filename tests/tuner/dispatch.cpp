@@ -0,0 +1,84 @@
+// RUN: %atjitc   %s -o %t
+// RUN: rm -f %t.db
+// RUN: %t %t.db > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <tuner/driver.h>
+#include <tuner/param.h>
+
+#include <functional>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+// a bound function that dispatches on its first argument is tuned
+// separately for small and large inputs, which are fastest with different
+// values of k. A size class seen for the first time starts from the best
+// config of its nearest neighbour.
+
+using namespace std::placeholders;
+using namespace tuned_param;
+using namespace easy::options;
+
+int scaled(int n, int k) {
+  int Reps = n < 1000 ? k * k : (5 - k) * (5 - k);
+  for (volatile int i = 0; i < Reps * 10000; i++)
+    ;
+  return n * k;
+}
+
+// the value recorded for the tunable parameter of a size class, if any.
+bool recorded(const char* Path, unsigned Class, int &Val) {
+  std::ifstream File(Path);
+  std::string Line;
+  std::string Variant = ";size_class=" + std::to_string(Class) + "\t";
+  while (std::getline(File, Line)) {
+    auto Pos = Line.find("param #2=");
+    if (Line.find(Variant) != std::string::npos && Pos != std::string::npos) {
+      Val = std::stoi(Line.substr(Pos + 9));
+      return true;
+    }
+  }
+  return false;
+}
+
+int main(int argc, char** argv) {
+
+  tuner::ATDriver AT(argv[1]);
+  auto F = AT.bind(scaled, _1, IntRange(1, 4, 2),
+                   tuner_kind(tuner::AT_Random),
+                   feedback_kind(tuner::FB_Total_IgnoreError),
+                   blocking(true),
+                   dispatch_on(1));
+
+  int Wrong = 0;
+  for (int i = 0; i < 400; i++) {
+    int N = (i % 2) ? 10 : 100'000;
+    int K = F(N) / N;
+    if (K < 1 || K > 4)
+      Wrong++;
+  }
+
+  // CHECK: wrong results: 0
+  printf("wrong results: %d\n", Wrong);
+
+  AT.saveTuning();
+
+  int Small = 0, Large = 0;
+  bool HaveBoth = recorded(argv[1], 4, Small) && recorded(argv[1], 17, Large);
+
+  // CHECK: best configs differ: 1
+  printf("best configs differ: %d\n", HaveBoth && Small != Large);
+
+  // 20 is in size class 5, next to the class of 10.
+  // CHECK: seeded from the neighbour: 1
+  int K = F(20) / 20;
+  printf("seeded from the neighbour: %d\n", K == Small);
+
+  // CHECK: "size_class" : 4
+  // CHECK: "size_class" : 5
+  // CHECK: "size_class" : 17
+  AT.exportStats(std::cout);
+
+  return 0;
+}
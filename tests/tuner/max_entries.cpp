@@ -0,0 +1,62 @@
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <tuner/driver.h>
+
+#include <functional>
+#include <cstdio>
+
+// each constant gets its own entry, and with room for only two of them,
+// one that was not used since the CLOCK hand last passed it, nor bound, is
+// evicted. A new entry is placed right behind the hand.
+
+using namespace std::placeholders;
+using namespace easy::options;
+
+int scale(int a, int b) {
+  return a * b;
+}
+
+tuner::ATDriver AT;
+
+void use(int k) {
+  auto const &F = AT.reoptimize(scale, _1, k, tuner_kind(tuner::AT_Random));
+  printf("scale(2, %d) is %d, evictions: %lu\n", k, F(2), (unsigned long) AT.evictions());
+}
+
+int main(int argc, char** argv) {
+
+  AT.setMaxEntries(2);
+
+  // CHECK: scale(2, 1) is 2, evictions: 0
+  // CHECK: scale(2, 2) is 4, evictions: 0
+  // CHECK: scale(2, 1) is 2, evictions: 0
+  use(1);
+  use(2);
+  use(1);
+
+  // 1 was used again since 2 was added, but 2 was not.
+  // CHECK: scale(2, 3) is 6, evictions: 1
+  // CHECK: scale(2, 1) is 2, evictions: 1
+  use(3);
+  use(1);
+
+  // the hand cleared 1's bit, but 1 was used again, unlike 3.
+  // CHECK: scale(2, 2) is 4, evictions: 2
+  // CHECK: scale(2, 1) is 2, evictions: 2
+  use(2);
+  use(1);
+
+  // a bound entry is never evicted, even when it was not used recently.
+  auto By5 = AT.bind(scale, _1, 5, tuner_kind(tuner::AT_Random));
+
+  // CHECK: scale(2, 6) is 12, evictions: 4
+  // CHECK: scale(2, 7) is 14, evictions: 5
+  // CHECK: By5(2) is 10, evictions: 5
+  use(6);
+  use(7);
+  printf("By5(2) is %d, evictions: %lu\n", By5(2), (unsigned long) AT.evictions());
+
+  return 0;
+}
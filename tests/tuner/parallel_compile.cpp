@@ -1,6 +1,9 @@
 // RUN: %atjitc   %s -o %t
 // RUN: %t
 
+// RUN: %atjitc -DWIDTH=4  %s -o %t
+// RUN: %t
+
 #include <tuner/driver.h>
 #include <tuner/param.h>
 
@@ -20,6 +23,10 @@ using namespace std::placeholders;
 using namespace tuned_param;
 using namespace easy::options;
 
+#ifndef WIDTH
+  #define WIDTH 1
+#endif
+
 std::atomic<int> dummy;
 
 void spin(int val, std::atomic<int> &dummy) {
@@ -43,7 +50,8 @@ int main(int argc, char** argv) {
           dummy,
           tuner_kind(TunerKind),
           feedback_kind(tuner::FB_Total_IgnoreError),
-          blocking(true)
+          blocking(true),
+          optimize_width(WIDTH)
           );
 
     OptimizedFun();
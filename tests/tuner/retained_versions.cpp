@@ -0,0 +1,70 @@
+// RUN: %atjitc -lpthread %s -o %t
+// RUN: %valgrind --error-exitcode=1 %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <tuner/driver.h>
+#include <tuner/param.h>
+
+#include <functional>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+
+// with room for only one version besides the best, the first version is
+// evicted as tuning goes on, since it is the slowest one. Another thread
+// keeps running it all along, so it must not be freed under that thread.
+
+using namespace std::placeholders;
+using namespace tuned_param;
+using namespace easy::options;
+
+// takes longer the larger b is.
+int scale(int a, int b) {
+  volatile int Spin = 0;
+  for (int i = 0; i < b * 1000; i++)
+    Spin = Spin + 1;
+  return a * b;
+}
+
+int main(int argc, char** argv) {
+
+  tuner::ATDriver AT;
+  auto Tune = [&]() -> auto const& {
+    return AT.reoptimize(scale, _1, IntRange(1, 8, 8),
+                         tuner_kind(tuner::AT_Random),
+                         feedback_kind(tuner::FB_Total_IgnoreError),
+                         blocking(true),
+                         retained_versions(1));
+  };
+
+  std::atomic<bool> Obtained = false, Done = false;
+  int HolderSaw = 0;
+
+  std::thread Holder([&]() {
+    // the first version uses the default, b = 8.
+    auto const &First = Tune();
+    Obtained = true;
+
+    HolderSaw = First(1);
+    while (!Done)
+      if (First(1) != HolderSaw)
+        HolderSaw = -1;
+  });
+
+  while (!Obtained)
+    std::this_thread::yield();
+
+  for (int i = 0; i < 40; i++)
+    Tune()(i);
+
+  Done = true;
+  Holder.join();
+
+  // CHECK: holder saw 8
+  printf("holder saw %d\n", HolderSaw);
+
+  // CHECK: "evictions" : {{[1-9][0-9]*}}
+  AT.exportStats(std::cout);
+
+  return 0;
+}
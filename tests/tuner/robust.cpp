@@ -0,0 +1,67 @@
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <tuner/driver.h>
+#include <tuner/param.h>
+
+#include <functional>
+#include <cstdio>
+
+// a few very slow calls must barely move the time reported by robust
+// feedback, whereas they dominate the mean.
+
+using namespace std::placeholders;
+using namespace tuned_param;
+using namespace easy::options;
+
+int work(int n, int k) {
+  volatile int sum = 0;
+  for (int i = 0; i < n; i++)
+    sum += i * k;
+  return sum;
+}
+
+// the same, so that it is tuned separately.
+int work_too(int n, int k) {
+  volatile int sum = 0;
+  for (int i = 0; i < n; i++)
+    sum += i * k;
+  return sum;
+}
+
+int main(int argc, char** argv) {
+
+  const int CALLS = 2000;
+
+  tuner::ATDriver AT;
+  auto const &Robust = AT.reoptimize(work, _1, IntRange(1, 4, 2),
+                    tuner_kind(tuner::AT_Random),
+                    feedback_kind(tuner::FB_Robust),
+                    blocking(true));
+
+  auto const &Total = AT.reoptimize(work_too, _1, IntRange(1, 4, 2),
+                    tuner_kind(tuner::AT_Random),
+                    feedback_kind(tuner::FB_Total),
+                    blocking(true));
+
+  // one call in 50 is a thousand times slower.
+  for (int i = 0; i < CALLS; i++) {
+    int n = i % 50 == 0 ? 500000 : 500;
+    Robust(n);
+    Total(n);
+  }
+
+  auto &RobustFB = Robust.getFeedback();
+  auto &TotalFB = Total.getFeedback();
+  RobustFB.updateStats();
+  TotalFB.updateStats();
+
+  // CHECK: measured: 1
+  // CHECK: ignores outliers: 1
+  printf("measured: %d\n", RobustFB.sampleSize() > 0);
+  printf("ignores outliers: %d\n",
+         RobustFB.expectedValue() * 5 < TotalFB.expectedValue());
+
+  return 0;
+}
@@ -0,0 +1,47 @@
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <tuner/driver.h>
+#include <tuner/param.h>
+
+#include <functional>
+#include <cstdio>
+
+// once the statistics of a frequently called version are good, sampled
+// feedback must stop measuring most of its calls.
+
+using namespace std::placeholders;
+using namespace tuned_param;
+using namespace easy::options;
+
+int work(int n, int k) {
+  volatile int sum = 0;
+  for (int i = 0; i < n; i++)
+    sum += i * k;
+  return sum;
+}
+
+int main(int argc, char** argv) {
+
+  const int CALLS = 100000;
+
+  tuner::ATDriver AT;
+  auto const &F = AT.reoptimize(work, _1, IntRange(1, 4, 2),
+                    tuner_kind(tuner::AT_Random),
+                    feedback_kind(tuner::FB_Sampled),
+                    blocking(true));
+
+  for (int i = 0; i < CALLS; i++)
+    F(500);
+
+  auto &FB = F.getFeedback();
+  FB.updateStats();
+
+  // CHECK: measured some: 1
+  // CHECK: skipped most: 1
+  printf("measured some: %d\n", FB.sampleSize() >= SAMPLE_ADAPT_EVERY);
+  printf("skipped most: %d\n", FB.sampleSize() < CALLS / 2);
+
+  return 0;
+}
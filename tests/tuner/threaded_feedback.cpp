@@ -0,0 +1,49 @@
+// RUN: %atjitc -lpthread %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <tuner/driver.h>
+#include <tuner/param.h>
+
+#include <functional>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// many threads call the same version at once. Each thread records its
+// measurements separately, and none of them may be lost when merged.
+
+using namespace std::placeholders;
+using namespace tuned_param;
+using namespace easy::options;
+
+int scale(int a, int b) {
+  return a * b;
+}
+
+int main(int argc, char** argv) {
+
+  const int THREADS = 8;
+  const int CALLS = 1000;
+
+  tuner::ATDriver AT;
+  auto const &F = AT.reoptimize(scale, _1, IntRange(1, 4, 2),
+                    tuner_kind(tuner::AT_Random),
+                    feedback_kind(tuner::FB_Total_IgnoreError),
+                    blocking(true));
+
+  std::vector<std::thread> Workers;
+  for (int t = 0; t < THREADS; t++)
+    Workers.emplace_back([&F, CALLS]() {
+      for (int i = 0; i < CALLS; i++)
+        F(i);
+    });
+
+  for (auto &W : Workers)
+    W.join();
+
+  // CHECK: "measurements" : 8000
+  AT.exportStats(std::cout);
+
+  return 0;
+}
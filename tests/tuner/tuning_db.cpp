@@ -0,0 +1,71 @@
+// RUN: %atjitc   %s -o %t
+// RUN: rm -f %t.db
+// RUN: %t %t.db > %t.first
+// RUN: %FileCheck --check-prefix=FIRST %s < %t.first
+// RUN: %FileCheck --check-prefix=DB %s < %t.db
+// RUN: %t %t.db > %t.second
+// RUN: %FileCheck --check-prefix=SECOND %s < %t.second
+
+#include <tuner/driver.h>
+#include <tuner/param.h>
+
+#include <functional>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+// the first run tunes from scratch and records its best config. The second
+// run must start from that config, rather than the default one.
+
+using namespace std::placeholders;
+using namespace tuned_param;
+using namespace easy::options;
+
+static int Received;
+
+void take(int i, int k) {
+  Received = k;
+}
+
+// the value recorded for the tunable parameter, if any.
+bool recorded(const char* Path, int &Val) {
+  std::ifstream File(Path);
+  std::string Line;
+  while (std::getline(File, Line)) {
+    auto Pos = Line.find("param #1=");
+    if (Pos != std::string::npos) {
+      Val = std::stoi(Line.substr(Pos + 9));
+      return true;
+    }
+  }
+  return false;
+}
+
+int main(int argc, char** argv) {
+  int Prior;
+  bool HavePrior = recorded(argv[1], Prior);
+
+  tuner::ATDriver AT(argv[1]);
+
+  for (int i = 0; i < 20; i++) {
+    auto const &F = AT.reoptimize(take, IntRange(-8, 9, 9), _1,
+                      tuner_kind(tuner::AT_Random),
+                      feedback_kind(tuner::FB_Total_IgnoreError),
+                      blocking(true));
+    F(i);
+
+    // FIRST: fresh start
+    // SECOND: seeded: 1
+    if (i == 0) {
+      if (HavePrior)
+        printf("seeded: %d\n", Received == Prior);
+      else
+        printf("fresh start\n");
+    }
+  }
+
+  return 0;
+}
+
+// DB: # atJIT tuning database
+// DB-NEXT: {{.*}}take{{.*}}param #1={{-?[0-9]+}}
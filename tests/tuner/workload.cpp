@@ -0,0 +1,53 @@
+// RUN: %atjitc   %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <tuner/driver.h>
+#include <tuner/param.h>
+
+#include <functional>
+#include <cmath>
+#include <cstdio>
+
+// calls on inputs of very different sizes report their workload, so that
+// the feedback tracks the time per element rather than per call, and the
+// spread of the measurements stays small.
+
+using namespace std::placeholders;
+using namespace tuned_param;
+using namespace easy::options;
+
+int sum(int n, int k) {
+  volatile int s = 0;
+  for (int i = 0; i < n; i++)
+    s += i * k;
+  return s;
+}
+
+int main(int argc, char** argv) {
+
+  tuner::ATDriver AT;
+  auto const &F = AT.reoptimize(sum, _1, IntRange(1, 4, 2),
+                    tuner_kind(tuner::AT_Random),
+                    feedback_kind(tuner::FB_Total_IgnoreError),
+                    blocking(true));
+
+  for (int i = 0; i < 200; i++) {
+    int N = (i % 2) ? 1'000 : 100'000;
+    tuner::setWorkload(N);
+    F(N);
+  }
+
+  auto &FB = F.getFeedback();
+  FB.updateStats();
+
+  double StdDev = std::sqrt(FB.variance());
+
+  // CHECK: per element: 1
+  printf("per element: %d\n", FB.expectedValue() < 100);
+
+  // CHECK: low spread: 1
+  printf("low spread: %d\n", StdDev < FB.expectedValue());
+
+  return 0;
+}
@@ -0,0 +1,52 @@
+// RUN: %atjitc -lpthread %s -o %t
+// RUN: %t > %t.out
+// RUN: %FileCheck %s < %t.out
+
+#include <tuner/Feedback.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+// the workload is kept per thread, and only the samples are divided by it:
+// the deployed time of a function is still its raw running time.
+
+int main(int argc, char** argv) {
+  using namespace std::chrono;
+
+  // CHECK: default: 1, zero: 1, negative: 1
+  double Default = tuner::currentWorkload();
+  tuner::setWorkload(0);
+  double Zero = tuner::currentWorkload();
+  tuner::setWorkload(-5);
+  printf("default: %g, zero: %g, negative: %g\n", Default, Zero, tuner::currentWorkload());
+
+  tuner::setWorkload(1000);
+
+  // CHECK: here: 1000, other thread: 1
+  double Other = 0;
+  std::thread([&] { Other = tuner::currentWorkload(); }).join();
+  printf("here: %g, other thread: %g\n", tuner::currentWorkload(), Other);
+
+  const int CALLS = 4;
+  tuner::TotalExecutionTime FB(-1);
+  for (int i = 0; i < CALLS; i++) {
+    auto Start = FB.startMeasurement();
+    std::this_thread::sleep_for(milliseconds(1));
+    FB.endMeasurement(Start);
+  }
+  FB.updateStats();
+
+  double Deployed = FB.getDeployedTime();
+  double PerUnit = FB.expectedValue();
+
+  // CHECK: samples per unit: 1
+  printf("samples per unit: %d\n",
+         std::abs(PerUnit * 1000 * CALLS - Deployed) < 0.01 * Deployed);
+
+  // CHECK: deployed time is raw: 1
+  printf("deployed time is raw: %d\n", Deployed >= CALLS * 1e6);
+
+  return 0;
+}